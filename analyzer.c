@@ -0,0 +1,124 @@
+#include "analyzer.h"
+
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define SPECTRUM_FLOOR_DB -90.0f // Bottom of the spectrum bars
+#define METER_FLOOR_DB -60.0f    // Bottom of the level meters
+#define FALL_DB_PER_SECOND 30.0f // Release of every display level
+
+// Linear amplitude to a display height, 0 at the floor and 1 at full scale
+static float to_height(float level, float floor_db)
+{
+    if (level <= 0.0f)
+        return 0.0f;
+
+    float db = 20.0f * log10f(level);
+    if (db <= floor_db)
+        return 0.0f;
+    return db >= 0.0f ? 1.0f : 1.0f - db / floor_db;
+}
+
+// Rise at once, fall by at most `fall`
+static float settle(float shown, float measured, float fall)
+{
+    return measured >= shown ? measured : SDL_max(measured, shown - fall);
+}
+
+bool analyzer_init(Analyzer *analyzer, int sample_rate, SDL_AudioFormat format, int channels)
+{
+    SDL_zerop(analyzer);
+    if (channels < 1 || channels > SYNTH_MAX_CHANNELS || !fft_init(&analyzer->fft, ANALYZER_SIZE))
+        return false;
+
+    analyzer->sample_rate = sample_rate;
+    analyzer->format = format;
+    analyzer->channels = channels;
+    analyzer->last_update = SDL_GetTicks();
+
+    for (int i = 0; i < ANALYZER_SIZE; i++)
+        analyzer->hann[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / ANALYZER_SIZE));
+
+    // Log spaced band edges, each band at least one bin wide
+    double top = sample_rate / 2.0;
+    int bins = ANALYZER_SIZE / 2 + 1;
+    for (int b = 0; b <= ANALYZER_BANDS; b++)
+    {
+        double frequency = ANALYZER_LOW_HZ * pow(top / ANALYZER_LOW_HZ, (double)b / ANALYZER_BANDS);
+        int bin = (int)(frequency * ANALYZER_SIZE / sample_rate);
+        if (b > 0)
+            bin = SDL_max(bin, analyzer->band_start[b - 1] + 1);
+        analyzer->band_start[b] = SDL_min(bin, bins - 1);
+    }
+    analyzer->band_start[ANALYZER_BANDS] = bins;
+    return true;
+}
+
+void analyzer_close(Analyzer *analyzer)
+{
+    fft_free(&analyzer->fft);
+}
+
+bool analyzer_update(Analyzer *analyzer, Tap *tap)
+{
+    const Uint8 *data = tap_read(tap);
+    if (!data)
+        return false;
+
+    Uint32 now = SDL_GetTicks();
+    float elapsed = (now - analyzer->last_update) / 1000.0f;
+    analyzer->last_update = now;
+
+    int channels = analyzer->channels;
+    float peak[SYNTH_MAX_CHANNELS] = {0};
+    float power[SYNTH_MAX_CHANNELS] = {0};
+    const float *f32 = (const float *)data;
+    const Sint16 *s16 = (const Sint16 *)data;
+
+    // Back to float full scale, meters per channel, the mono mix for the
+    // scope and the spectrum
+    for (int i = 0; i < ANALYZER_SIZE; i++)
+    {
+        float sum = 0.0f;
+        for (int c = 0; c < channels; c++)
+        {
+            int index = i * channels + c;
+            float sample = analyzer->format == AUDIO_F32SYS ? f32[index] : s16[index] * (1.0f / 32768.0f);
+            peak[c] = SDL_max(peak[c], fabsf(sample));
+            power[c] += sample * sample;
+            sum += sample;
+        }
+        analyzer->mono[i] = sum / channels;
+        analyzer->windowed[i] = analyzer->mono[i] * analyzer->hann[i];
+    }
+
+    bool was_visible = analyzer->visible;
+    bool visible = false;
+    float fall = FALL_DB_PER_SECOND * elapsed / -METER_FLOOR_DB;
+    for (int c = 0; c < channels; c++)
+    {
+        analyzer->peak[c] = settle(analyzer->peak[c], to_height(peak[c], METER_FLOOR_DB), fall);
+        analyzer->rms[c] = settle(analyzer->rms[c], to_height(sqrtf(power[c] / ANALYZER_SIZE), METER_FLOOR_DB), fall);
+        visible |= analyzer->peak[c] > 0.0f;
+    }
+
+    // The Hann window halves a sine's bin, so a full scale sine reaches
+    // size / 4 before this scaling
+    fft_real(&analyzer->fft, analyzer->windowed, analyzer->re, analyzer->im);
+    float scale = 4.0f / ANALYZER_SIZE;
+    fall = FALL_DB_PER_SECOND * elapsed / -SPECTRUM_FLOOR_DB;
+    for (int b = 0; b < ANALYZER_BANDS; b++)
+    {
+        float strongest = 0.0f;
+        for (int k = analyzer->band_start[b]; k < analyzer->band_start[b + 1]; k++)
+            strongest = SDL_max(strongest, analyzer->re[k] * analyzer->re[k] + analyzer->im[k] * analyzer->im[k]);
+        analyzer->bands[b] = settle(analyzer->bands[b], to_height(sqrtf(strongest) * scale, SPECTRUM_FLOOR_DB), fall);
+        visible |= analyzer->bands[b] > 0.0f;
+    }
+
+    analyzer->visible = visible;
+    return visible || was_visible;
+}
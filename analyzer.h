@@ -0,0 +1,48 @@
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <SDL.h>
+#include <stdbool.h>
+
+#include "fft.h"
+#include "synth_kernels.h"
+#include "tap.h"
+
+#define ANALYZER_SIZE 2048   // FFT length, also the tap window and the oscilloscope history
+#define ANALYZER_BANDS 48    // Spectrum bars, log spaced
+#define ANALYZER_LOW_HZ 40.0 // Bottom of the first band
+
+// Display-side analysis of the output tap: a Hann windowed real FFT summed
+// into log spaced bands, plus peak and RMS meters per channel. Everything
+// runs on the thread calling analyzer_update(), the audio thread only
+// copies its buffers into the tap. Levels are kept as display heights in
+// 0..1 and fall back smoothly instead of dropping with each window.
+typedef struct Analyzer
+{
+    Fft fft;
+    int sample_rate;
+    SDL_AudioFormat format; // Of the tap, AUDIO_F32SYS or AUDIO_S16SYS
+    int channels;
+    Uint32 last_update; // SDL_GetTicks() of the previous window
+    bool visible;       // Some level is above the display floor
+
+    float mono[ANALYZER_SIZE]; // Latest window, channels averaged, 1.0 is full scale
+    float bands[ANALYZER_BANDS];
+    float peak[SYNTH_MAX_CHANNELS];
+    float rms[SYNTH_MAX_CHANNELS];
+
+    int band_start[ANALYZER_BANDS + 1]; // First FFT bin of each band
+    float hann[ANALYZER_SIZE];
+    float windowed[ANALYZER_SIZE];
+    float re[ANALYZER_SIZE / 2 + 1];
+    float im[ANALYZER_SIZE / 2 + 1];
+} Analyzer;
+
+bool analyzer_init(Analyzer *analyzer, int sample_rate, SDL_AudioFormat format, int channels);
+void analyzer_close(Analyzer *analyzer);
+
+// Analyze the newest tap window if there is one. Returns true when the
+// display changed, false when there was nothing new or it stayed blank.
+bool analyzer_update(Analyzer *analyzer, Tap *tap);
+
+#endif
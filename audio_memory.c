@@ -0,0 +1,135 @@
+#include "audio_memory.h"
+
+#include <stdio.h>
+
+bool audio_arena_init(AudioArena *arena, size_t size)
+{
+    SDL_zerop(arena);
+    arena->base = SDL_calloc(1, size + AUDIO_ARENA_ALIGN);
+    if (!arena->base)
+        return false;
+    arena->size = size + AUDIO_ARENA_ALIGN;
+    // Start the first block on an aligned address
+    arena->used = (AUDIO_ARENA_ALIGN - (uintptr_t)arena->base % AUDIO_ARENA_ALIGN) % AUDIO_ARENA_ALIGN;
+    return true;
+}
+
+void audio_arena_free(AudioArena *arena)
+{
+    SDL_free(arena->base);
+    SDL_zerop(arena);
+}
+
+void *audio_arena_alloc(AudioArena *arena, size_t size)
+{
+    size_t rounded = (size + AUDIO_ARENA_ALIGN - 1) & ~(size_t)(AUDIO_ARENA_ALIGN - 1);
+
+    if (!arena->base || rounded > arena->size - arena->used)
+        return NULL;
+
+    void *block = arena->base + arena->used;
+    arena->used += rounded;
+    return block;
+}
+
+#ifdef SYNTH_ALLOC_TRAP
+
+static _Thread_local bool in_realtime = false;
+static SDL_malloc_func real_malloc;
+static SDL_calloc_func real_calloc;
+static SDL_realloc_func real_realloc;
+static SDL_free_func real_free;
+
+// Reports from inside an allocator, so no formatting and no SDL_Log
+static void trap(const char *call)
+{
+    in_realtime = false;
+    fputs("Heap ", stderr);
+    fputs(call, stderr);
+    fputs(" on a real-time audio thread\n", stderr);
+    SDL_TriggerBreakpoint();
+}
+
+static void *trap_malloc(size_t size)
+{
+    if (in_realtime)
+        trap("malloc");
+    return real_malloc(size);
+}
+
+static void *trap_calloc(size_t count, size_t size)
+{
+    if (in_realtime)
+        trap("calloc");
+    return real_calloc(count, size);
+}
+
+static void *trap_realloc(void *memory, size_t size)
+{
+    if (in_realtime)
+        trap("realloc");
+    return real_realloc(memory, size);
+}
+
+static void trap_free(void *memory)
+{
+    if (in_realtime)
+        trap("free");
+    real_free(memory);
+}
+
+void audio_memory_install_trap(void)
+{
+    // The wrappers forward to the previous functions, so blocks from before
+    // the switch are still freed by the allocator that made them
+    SDL_GetMemoryFunctions(&real_malloc, &real_calloc, &real_realloc, &real_free);
+    SDL_SetMemoryFunctions(trap_malloc, trap_calloc, trap_realloc, trap_free);
+}
+
+void audio_memory_enter_rt(void)
+{
+    in_realtime = true;
+}
+
+void audio_memory_leave_rt(void)
+{
+    in_realtime = false;
+}
+
+#ifdef SYNTH_ALLOC_TRAP_LIBC
+// Linked with --wrap, our objects' direct libc calls land here
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *memory, size_t size);
+void __real_free(void *memory);
+
+void *__wrap_malloc(size_t size)
+{
+    if (in_realtime)
+        trap("malloc");
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    if (in_realtime)
+        trap("calloc");
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *memory, size_t size)
+{
+    if (in_realtime)
+        trap("realloc");
+    return __real_realloc(memory, size);
+}
+
+void __wrap_free(void *memory)
+{
+    if (in_realtime)
+        trap("free");
+    __real_free(memory);
+}
+#endif
+
+#endif // SYNTH_ALLOC_TRAP
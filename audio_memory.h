@@ -0,0 +1,45 @@
+#ifndef AUDIO_MEMORY_H
+#define AUDIO_MEMORY_H
+
+#include <SDL.h>
+#include <stdbool.h>
+
+#define AUDIO_ARENA_ALIGN 64 // Every arena block starts on its own cache line
+
+// Preallocated memory for audio-side objects. The arena is one block taken
+// at startup and carved up with a bump pointer; nothing in it is freed on
+// its own, the whole arena goes at shutdown. Voices live in fixed arrays of
+// the synth and graph nodes in plans built off the audio thread, so nothing
+// the audio thread uses comes and goes while playing.
+typedef struct AudioArena
+{
+    Uint8 *base;
+    size_t size;
+    size_t used;
+} AudioArena;
+
+bool audio_arena_init(AudioArena *arena, size_t size);
+void audio_arena_free(AudioArena *arena);
+
+// Zeroed, AUDIO_ARENA_ALIGN aligned block, NULL once the arena is full.
+// Meant for setup, before the audio device starts.
+void *audio_arena_alloc(AudioArena *arena, size_t size);
+
+// Allocation trap for real-time threads, built with SYNTH_ALLOC_TRAP. Once
+// installed, any SDL_malloc/calloc/realloc/free made between
+// audio_memory_enter_rt() and audio_memory_leave_rt() on the same thread
+// prints the call and raises a breakpoint. Builds linked with
+// -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free trap direct
+// libc calls from our own objects too. Without SYNTH_ALLOC_TRAP these are
+// no-ops.
+#ifdef SYNTH_ALLOC_TRAP
+void audio_memory_install_trap(void);
+void audio_memory_enter_rt(void);
+void audio_memory_leave_rt(void);
+#else
+#define audio_memory_install_trap() ((void)0)
+#define audio_memory_enter_rt() ((void)0)
+#define audio_memory_leave_rt() ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,102 @@
+#include "audio_stats.h"
+
+void audio_stats_init(AudioStats *stats, int sample_rate)
+{
+    SDL_zerop(stats);
+    stats->ticks_per_frame = (double)SDL_GetPerformanceFrequency() / sample_rate;
+}
+
+Uint64 audio_stats_begin(AudioStats *stats)
+{
+    (void)stats;
+    return SDL_GetPerformanceCounter();
+}
+
+void audio_stats_end(AudioStats *stats, Uint64 start, int frames)
+{
+    Uint64 end = SDL_GetPerformanceCounter();
+    Uint64 period = (Uint64)(frames * stats->ticks_per_frame);
+    AudioStatsData *d = &stats->data;
+
+    if (period == 0)
+        return;
+
+    double load = (double)(end - start) / period;
+    int bucket = (int)(load * (STATS_BUCKETS - 1));
+    if (bucket > STATS_BUCKETS - 1)
+        bucket = STATS_BUCKETS - 1;
+
+    SDL_AtomicAdd(&stats->sequence, 1);
+    SDL_MemoryBarrierRelease();
+
+    if (stats->last_start != 0 && start - stats->last_start > period + period / 2)
+        d->late_callbacks++;
+    if (end - start > period)
+        d->deadline_misses++;
+    if (load > d->max_load)
+        d->max_load = load;
+    d->callbacks++;
+    d->busy_ticks += end - start;
+    d->period_ticks += period;
+    d->histogram[bucket]++;
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicAdd(&stats->sequence, 1);
+
+    stats->last_start = start;
+}
+
+void audio_stats_snapshot(AudioStats *stats, AudioStatsData *out)
+{
+    for (;;)
+    {
+        int before = SDL_AtomicGet(&stats->sequence);
+        if (before & 1)
+            continue; // Writer is mid-update, it finishes within a few instructions
+
+        SDL_MemoryBarrierAcquire();
+        *out = stats->data;
+        SDL_MemoryBarrierAcquire();
+
+        if (SDL_AtomicGet(&stats->sequence) == before)
+            return;
+    }
+}
+
+double audio_stats_percentile(const AudioStatsData *data, double percent)
+{
+    Uint64 target = (Uint64)(data->callbacks * percent / 100.0);
+    Uint64 seen = 0;
+
+    for (int i = 0; i < STATS_BUCKETS; i++)
+    {
+        seen += data->histogram[i];
+        if (seen > target)
+            return i < STATS_BUCKETS - 1 ? (double)(i + 1) / (STATS_BUCKETS - 1) : data->max_load;
+    }
+    return data->max_load;
+}
+
+void audio_stats_log(const AudioStatsData *data)
+{
+    if (data->callbacks == 0)
+        return;
+
+    SDL_Log("Audio thread: %llu callbacks, load avg %.1f%% p50 <%.0f%% p99 <%.0f%% max %.1f%%",
+            (unsigned long long)data->callbacks, 100.0 * data->busy_ticks / data->period_ticks,
+            100.0 * audio_stats_percentile(data, 50.0), 100.0 * audio_stats_percentile(data, 99.0),
+            100.0 * data->max_load);
+    SDL_Log("Audio thread: %llu deadline misses, %llu late callbacks",
+            (unsigned long long)data->deadline_misses, (unsigned long long)data->late_callbacks);
+
+    for (int i = 0; i < STATS_BUCKETS; i++)
+    {
+        if (data->histogram[i] == 0)
+            continue;
+        if (i == STATS_BUCKETS - 1)
+            SDL_Log("  >=100%%      %u", data->histogram[i]);
+        else
+            SDL_Log("  %3d-%3d%%    %u", i * 100 / (STATS_BUCKETS - 1), (i + 1) * 100 / (STATS_BUCKETS - 1),
+                    data->histogram[i]);
+    }
+}
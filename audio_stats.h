@@ -0,0 +1,45 @@
+#ifndef AUDIO_STATS_H
+#define AUDIO_STATS_H
+
+#include <SDL.h>
+
+#define STATS_BUCKETS 21 // 5% of the buffer period each, the last one is >= 100%
+
+// Counters for the audio thread, updated once per callback. Only the audio
+// thread writes them; readers take a consistent copy with
+// audio_stats_snapshot(), which never blocks the writer (a sequence lock).
+typedef struct AudioStatsData
+{
+    Uint64 callbacks;
+    Uint64 deadline_misses; // Callbacks that took longer than the audio they produced
+    Uint64 late_callbacks;  // Callbacks that started more than 1.5 periods after the previous one
+    Uint64 busy_ticks;      // Total time spent rendering
+    Uint64 period_ticks;    // Total audio time produced
+    double max_load;        // Worst duration / period
+    Uint32 histogram[STATS_BUCKETS];
+} AudioStatsData;
+
+typedef struct AudioStats
+{
+    SDL_atomic_t sequence; // Odd while the audio thread is updating
+    double ticks_per_frame;
+    Uint64 last_start;
+    AudioStatsData data;
+} AudioStats;
+
+void audio_stats_init(AudioStats *stats, int sample_rate);
+
+// Audio thread: bracket the work of one callback producing `frames`
+Uint64 audio_stats_begin(AudioStats *stats);
+void audio_stats_end(AudioStats *stats, Uint64 start, int frames);
+
+// Any thread: copy the counters, lock-free for the audio thread
+void audio_stats_snapshot(AudioStats *stats, AudioStatsData *out);
+
+// Duration as a fraction of the period below which `percent` of the
+// callbacks fell, estimated from the histogram
+double audio_stats_percentile(const AudioStatsData *data, double percent);
+
+void audio_stats_log(const AudioStatsData *data);
+
+#endif
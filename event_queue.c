@@ -0,0 +1,67 @@
+#include "event_queue.h"
+
+void event_queue_init(EventQueue *queue)
+{
+    SDL_zerop(queue);
+}
+
+bool event_queue_push(EventQueue *queue, const SynthEvent *event)
+{
+    int head = SDL_AtomicGet(&queue->head);
+    int tail = SDL_AtomicGet(&queue->tail);
+
+    if ((unsigned)(head - tail) >= EVENT_QUEUE_SIZE)
+        return false;
+
+    queue->events[head & (EVENT_QUEUE_SIZE - 1)] = *event;
+
+    // Publish the slot contents before the new head
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&queue->head, head + 1);
+    return true;
+}
+
+const SynthEvent *event_queue_peek(EventQueue *queue)
+{
+    int tail = SDL_AtomicGet(&queue->tail);
+    int head = SDL_AtomicGet(&queue->head);
+
+    if (head == tail)
+        return NULL;
+
+    // Read the slot only after seeing the head that published it
+    SDL_MemoryBarrierAcquire();
+    return &queue->events[tail & (EVENT_QUEUE_SIZE - 1)];
+}
+
+void event_queue_pop(EventQueue *queue)
+{
+    int tail = SDL_AtomicGet(&queue->tail);
+
+    // Finish reading the slot before handing it back to the producer
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&queue->tail, tail + 1);
+}
+
+void event_fanout_init(EventFanout *fanout)
+{
+    SDL_zerop(fanout);
+}
+
+bool event_fanout_add(EventFanout *fanout, EventQueue *queue)
+{
+    if (fanout->count == EVENT_FANOUT_MAX)
+        return false;
+
+    fanout->queues[fanout->count++] = queue;
+    return true;
+}
+
+bool event_fanout_push(EventFanout *fanout, const SynthEvent *event)
+{
+    bool ok = true;
+
+    for (int i = 0; i < fanout->count; i++)
+        ok = event_queue_push(fanout->queues[i], event) && ok;
+    return ok;
+}
@@ -0,0 +1,61 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <SDL.h>
+#include <stdbool.h>
+
+#define EVENT_QUEUE_SIZE 256 // Must be a power of two
+#define EVENT_FANOUT_MAX 4   // Consumers one producer can feed
+
+// Event types understood by the synth
+enum
+{
+    EVENT_NOTE_ON = 0,
+    EVENT_NOTE_OFF,
+    EVENT_CONTROL, // MIDI control change
+    EVENT_PARAM    // Patch parameter, see synth_set_param()
+};
+
+typedef struct SynthEvent
+{
+    Uint64 time; // SDL_GetPerformanceCounter() when the event happened
+    Uint8 type;
+    Uint8 note;    // Note number, or controller number for EVENT_CONTROL
+    Uint8 value;   // Velocity, or controller value for EVENT_CONTROL
+    float amount;  // Parameter value for EVENT_PARAM, `note` is the parameter
+} SynthEvent;
+
+// Wait-free single-producer/single-consumer ring buffer. Only the producer
+// writes `head` and only the consumer writes `tail`, so neither side ever
+// blocks or takes a lock.
+typedef struct EventQueue
+{
+    SDL_atomic_t head;
+    SDL_atomic_t tail;
+    SynthEvent events[EVENT_QUEUE_SIZE];
+} EventQueue;
+
+void event_queue_init(EventQueue *queue);
+
+// Producer side, returns false when the queue is full and the event was dropped
+bool event_queue_push(EventQueue *queue, const SynthEvent *event);
+
+// Consumer side, peek returns the oldest event or NULL, pop discards it
+const SynthEvent *event_queue_peek(EventQueue *queue);
+void event_queue_pop(EventQueue *queue);
+
+// One producer feeding the same events to several consumers, a queue each.
+// A full queue only drops the event for its own consumer.
+typedef struct EventFanout
+{
+    EventQueue *queues[EVENT_FANOUT_MAX];
+    int count;
+} EventFanout;
+
+void event_fanout_init(EventFanout *fanout);
+bool event_fanout_add(EventFanout *fanout, EventQueue *queue);
+
+// Producer side, returns false when some queue was full and dropped its copy
+bool event_fanout_push(EventFanout *fanout, const SynthEvent *event);
+
+#endif
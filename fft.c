@@ -0,0 +1,287 @@
+#include "fft.h"
+
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FFT_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define FFT_NEON 1
+#include <arm_neon.h>
+#endif
+
+// One radix-2 stage over `n` complex points: each point in the lower half
+// of a 2 * span group is paired with the one `span` above it, and point j
+// of the group takes twiddle j
+static void stage_scalar(float *re, float *im, const float *wr, const float *wi, int n, int span)
+{
+    for (int k = 0; k < n; k += 2 * span)
+    {
+        for (int j = 0; j < span; j++)
+        {
+            int a = k + j;
+            int b = a + span;
+            float tr = re[b] * wr[j] - im[b] * wi[j];
+            float ti = re[b] * wi[j] + im[b] * wr[j];
+            re[b] = re[a] - tr;
+            im[b] = im[a] - ti;
+            re[a] += tr;
+            im[a] += ti;
+        }
+    }
+}
+
+// The SIMD stages run lanes across j, spans narrower than a vector fall back
+// to the scalar loop
+
+#ifdef FFT_X86
+
+__attribute__((target("sse2"))) static void stage_sse2(float *re, float *im, const float *wr, const float *wi, int n,
+                                                       int span)
+{
+    if (span < 4)
+    {
+        stage_scalar(re, im, wr, wi, n, span);
+        return;
+    }
+
+    for (int k = 0; k < n; k += 2 * span)
+    {
+        for (int j = 0; j < span; j += 4)
+        {
+            float *ar = re + k + j, *ai = im + k + j;
+            float *br = ar + span, *bi = ai + span;
+            __m128 w_r = _mm_loadu_ps(wr + j), w_i = _mm_loadu_ps(wi + j);
+            __m128 b_r = _mm_loadu_ps(br), b_i = _mm_loadu_ps(bi);
+            __m128 a_r = _mm_loadu_ps(ar), a_i = _mm_loadu_ps(ai);
+            __m128 tr = _mm_sub_ps(_mm_mul_ps(b_r, w_r), _mm_mul_ps(b_i, w_i));
+            __m128 ti = _mm_add_ps(_mm_mul_ps(b_r, w_i), _mm_mul_ps(b_i, w_r));
+            _mm_storeu_ps(br, _mm_sub_ps(a_r, tr));
+            _mm_storeu_ps(bi, _mm_sub_ps(a_i, ti));
+            _mm_storeu_ps(ar, _mm_add_ps(a_r, tr));
+            _mm_storeu_ps(ai, _mm_add_ps(a_i, ti));
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static void stage_avx2(float *re, float *im, const float *wr, const float *wi, int n,
+                                                       int span)
+{
+    if (span < 8)
+    {
+        stage_sse2(re, im, wr, wi, n, span);
+        return;
+    }
+
+    for (int k = 0; k < n; k += 2 * span)
+    {
+        for (int j = 0; j < span; j += 8)
+        {
+            float *ar = re + k + j, *ai = im + k + j;
+            float *br = ar + span, *bi = ai + span;
+            __m256 w_r = _mm256_loadu_ps(wr + j), w_i = _mm256_loadu_ps(wi + j);
+            __m256 b_r = _mm256_loadu_ps(br), b_i = _mm256_loadu_ps(bi);
+            __m256 a_r = _mm256_loadu_ps(ar), a_i = _mm256_loadu_ps(ai);
+            __m256 tr = _mm256_sub_ps(_mm256_mul_ps(b_r, w_r), _mm256_mul_ps(b_i, w_i));
+            __m256 ti = _mm256_add_ps(_mm256_mul_ps(b_r, w_i), _mm256_mul_ps(b_i, w_r));
+            _mm256_storeu_ps(br, _mm256_sub_ps(a_r, tr));
+            _mm256_storeu_ps(bi, _mm256_sub_ps(a_i, ti));
+            _mm256_storeu_ps(ar, _mm256_add_ps(a_r, tr));
+            _mm256_storeu_ps(ai, _mm256_add_ps(a_i, ti));
+        }
+    }
+}
+
+#endif // FFT_X86
+
+#ifdef FFT_NEON
+
+static void stage_neon(float *re, float *im, const float *wr, const float *wi, int n, int span)
+{
+    if (span < 4)
+    {
+        stage_scalar(re, im, wr, wi, n, span);
+        return;
+    }
+
+    for (int k = 0; k < n; k += 2 * span)
+    {
+        for (int j = 0; j < span; j += 4)
+        {
+            float *ar = re + k + j, *ai = im + k + j;
+            float *br = ar + span, *bi = ai + span;
+            float32x4_t w_r = vld1q_f32(wr + j), w_i = vld1q_f32(wi + j);
+            float32x4_t b_r = vld1q_f32(br), b_i = vld1q_f32(bi);
+            float32x4_t a_r = vld1q_f32(ar), a_i = vld1q_f32(ai);
+            float32x4_t tr = vmlsq_f32(vmulq_f32(b_r, w_r), b_i, w_i);
+            float32x4_t ti = vmlaq_f32(vmulq_f32(b_r, w_i), b_i, w_r);
+            vst1q_f32(br, vsubq_f32(a_r, tr));
+            vst1q_f32(bi, vsubq_f32(a_i, ti));
+            vst1q_f32(ar, vaddq_f32(a_r, tr));
+            vst1q_f32(ai, vaddq_f32(a_i, ti));
+        }
+    }
+}
+
+#endif // FFT_NEON
+
+bool fft_init(Fft *fft, int size)
+{
+    SDL_zerop(fft);
+    if (size < 4 || size > FFT_MAX_SIZE || (size & (size - 1)))
+        return false;
+
+    int half = size / 2;
+    fft->size = size;
+    fft->half = half;
+    fft->reverse = SDL_malloc(half * sizeof(int));
+    fft->twiddle_re = SDL_malloc(half * sizeof(float));
+    fft->twiddle_im = SDL_malloc(half * sizeof(float));
+    fft->split_re = SDL_malloc((half / 2 + 1) * sizeof(float));
+    fft->split_im = SDL_malloc((half / 2 + 1) * sizeof(float));
+    if (!fft->reverse || !fft->twiddle_re || !fft->twiddle_im || !fft->split_re || !fft->split_im)
+    {
+        fft_free(fft);
+        return false;
+    }
+
+    int bits = 0;
+    while ((1 << bits) < half)
+        bits++;
+    for (int k = 0; k < half; k++)
+    {
+        int r = 0;
+        for (int b = 0; b < bits; b++)
+            r |= ((k >> b) & 1) << (bits - 1 - b);
+        fft->reverse[k] = r;
+    }
+
+    // Computed in double, the error would otherwise grow with every stage
+    fft->twiddle_re[0] = 1.0f;
+    fft->twiddle_im[0] = 0.0f;
+    for (int span = 1; span < half; span *= 2)
+    {
+        for (int j = 0; j < span; j++)
+        {
+            double angle = -M_PI * j / span;
+            fft->twiddle_re[span + j] = (float)cos(angle);
+            fft->twiddle_im[span + j] = (float)sin(angle);
+        }
+    }
+    for (int k = 0; k <= half / 2; k++)
+    {
+        double angle = -2.0 * M_PI * k / size;
+        fft->split_re[k] = (float)cos(angle);
+        fft->split_im[k] = (float)sin(angle);
+    }
+
+    fft->stage = stage_scalar;
+#ifdef FFT_X86
+    if (SDL_HasAVX2())
+        fft->stage = stage_avx2;
+    else if (SDL_HasSSE2())
+        fft->stage = stage_sse2;
+#endif
+#ifdef FFT_NEON
+    if (SDL_HasNEON())
+        fft->stage = stage_neon;
+#endif
+    return true;
+}
+
+void fft_free(Fft *fft)
+{
+    SDL_free(fft->reverse);
+    SDL_free(fft->twiddle_re);
+    SDL_free(fft->twiddle_im);
+    SDL_free(fft->split_re);
+    SDL_free(fft->split_im);
+    SDL_zerop(fft);
+}
+
+// The real input is transformed as `half` complex points, even samples as
+// the real part and odd ones as the imaginary part, then split into the
+// spectra of the two halves and recombined
+void fft_real(const Fft *fft, const float *in, float *re, float *im)
+{
+    int half = fft->half;
+
+    for (int k = 0; k < half; k++)
+    {
+        int r = fft->reverse[k];
+        re[k] = in[2 * r];
+        im[k] = in[2 * r + 1];
+    }
+    for (int span = 1; span < half; span *= 2)
+        fft->stage(re, im, fft->twiddle_re + span, fft->twiddle_im + span, half, span);
+
+    // Bins k and half - k together: E and O are the even and odd sample
+    // spectra, X[k] = E + W^k O and X[half - k] = conj(E - W^k O)
+    re[half] = re[0];
+    im[half] = im[0];
+    for (int k = 0; k <= half / 2; k++)
+    {
+        int m = half - k;
+        float er = 0.5f * (re[k] + re[m]);
+        float ei = 0.5f * (im[k] - im[m]);
+        float odd_r = 0.5f * (im[k] + im[m]);
+        float odd_i = -0.5f * (re[k] - re[m]);
+        float tr = fft->split_re[k] * odd_r - fft->split_im[k] * odd_i;
+        float ti = fft->split_re[k] * odd_i + fft->split_im[k] * odd_r;
+        re[k] = er + tr;
+        im[k] = ei + ti;
+        re[m] = er - tr;
+        im[m] = ti - ei;
+    }
+}
+
+// The steps of fft_real() backwards: the two half spectra are rebuilt from
+// bins k and half - k and packed into one complex spectrum, which goes
+// through the forward stages conjugated, as conj(FFT(conj(Z))) is the
+// inverse. `out` holds the packed spectrum on the way.
+void fft_real_inverse(const Fft *fft, float *re, float *im, float *out)
+{
+    int half = fft->half;
+
+    // E = X[k] + conj(X[half - k]), O = (X[k] - conj(X[half - k])) W^-k,
+    // Z[k] = E + iO and Z[half - k] = conj(E) + i conj(O)
+    for (int k = 0; k <= half / 2; k++)
+    {
+        int m = half - k;
+        float er = re[k] + re[m];
+        float ei = im[k] - im[m];
+        float dr = re[k] - re[m];
+        float di = im[k] + im[m];
+        float odd_r = dr * fft->split_re[k] + di * fft->split_im[k];
+        float odd_i = di * fft->split_re[k] - dr * fft->split_im[k];
+        out[2 * k] = er - odd_i;
+        out[2 * k + 1] = ei + odd_r;
+        if (m < half)
+        {
+            out[2 * m] = er + odd_i;
+            out[2 * m + 1] = odd_r - ei;
+        }
+    }
+
+    for (int k = 0; k < half; k++)
+    {
+        int r = fft->reverse[k];
+        re[k] = out[2 * r];
+        im[k] = -out[2 * r + 1];
+    }
+    for (int span = 1; span < half; span *= 2)
+        fft->stage(re, im, fft->twiddle_re + span, fft->twiddle_im + span, half, span);
+
+    // Even samples are the real part, odd ones the imaginary part
+    for (int k = 0; k < half; k++)
+    {
+        out[2 * k] = re[k];
+        out[2 * k + 1] = -im[k];
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <SDL.h>
+#include <stdbool.h>
+
+#define FFT_MAX_SIZE 65536
+
+// Radix-2 FFT plan. The tables are computed once by fft_init(), a transform
+// only reads them, so one plan can serve several threads. Complex data is
+// split into separate real and imaginary arrays, so the butterflies of a
+// stage run across SIMD lanes.
+typedef struct Fft
+{
+    int size;  // Real transform length, a power of two
+    int half;  // Complex transform length, size / 2
+    void (*stage)(float *re, float *im, const float *wr, const float *wi, int n, int span);
+    int *reverse; // Bit reversal permutation of `half` points
+    // Stage twiddles, the span s ones at s..2s-1, e^(-2 pi i j / 2s)
+    float *twiddle_re;
+    float *twiddle_im;
+    // Real transform split, e^(-2 pi i k / size) for k < half
+    float *split_re;
+    float *split_im;
+} Fft;
+
+// `size` from 4 to FFT_MAX_SIZE, a power of two
+bool fft_init(Fft *fft, int size);
+void fft_free(Fft *fft);
+
+// Forward transform of `size` real samples into bins 0..size/2, so `re` and
+// `im` hold size / 2 + 1 values each. Unnormalized: a full scale sine gives
+// a magnitude of size / 2.
+void fft_real(const Fft *fft, const float *in, float *re, float *im);
+
+// Inverse of fft_real(), bins 0..size/2 back to `size` real samples in
+// `out`. Overwrites `re` and `im`. Unnormalized too, so a forward and an
+// inverse transform scale by `size`.
+void fft_real_inverse(const Fft *fft, float *re, float *im, float *out);
+
+#endif
@@ -0,0 +1,652 @@
+#include "graph.h"
+
+#include <math.h>
+
+#include "reverb.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define GRAPH_SLOTS (GRAPH_MAX_NODES + 1) // The bus and at most one per node
+#define BUS_STRIDE (SYNTH_MAX_CHANNELS * SYNTH_BLOCK_SIZE)
+#define STATEMENT_LENGTH 256
+#define FILTER_SILENCE 1e-15f // Filter memory below this is flushed, no denormals while quiet
+#define TAIL_SILENCE 1e-5f    // A delay or reverb tail below this, -100 dB, no longer keeps the graph busy
+#define DELAY_FEEDBACK 0.35f
+#define MAX_FEEDBACK 0.99f
+
+static const char *const type_names[GRAPH_NODE_TYPES] = {"voices", "osc", "lowpass", "highpass",
+                                                         "gain",   "mix", "delay",   "reverb"};
+static const Uint8 min_inputs[GRAPH_NODE_TYPES] = {0, 0, 1, 1, 1, 1, 1, 1};
+static const Uint8 max_inputs[GRAPH_NODE_TYPES] = {0, 0, 1, 1, 1, GRAPH_MAX_INPUTS, 1, 1};
+static const float default_values[GRAPH_NODE_TYPES] = {0.0f, 440.0f, 1000.0f, 100.0f, 1.0f, 0.0f, 0.25f, 0.0f};
+
+void graph_desc_init(GraphDesc *desc)
+{
+    SDL_zerop(desc);
+    SDL_strlcpy(desc->nodes[0].name, "voices", GRAPH_NAME_LENGTH);
+    desc->nodes[0].type = GRAPH_VOICES;
+    desc->node_count = 1;
+    desc->output = 0;
+}
+
+int graph_find(const GraphDesc *desc, const char *name)
+{
+    for (int n = 0; n < desc->node_count; n++)
+        if (SDL_strcmp(desc->nodes[n].name, name) == 0)
+            return n;
+    return -1;
+}
+
+int graph_add(GraphDesc *desc, const char *name, int type, float value)
+{
+    if (desc->node_count == GRAPH_MAX_NODES || type <= GRAPH_VOICES || type >= GRAPH_NODE_TYPES ||
+        SDL_strlen(name) >= GRAPH_NAME_LENGTH || graph_find(desc, name) >= 0)
+        return -1;
+
+    GraphNode *node = &desc->nodes[desc->node_count];
+    SDL_zerop(node);
+    SDL_strlcpy(node->name, name, GRAPH_NAME_LENGTH);
+    node->type = (Uint8)type;
+    node->value = value;
+    node->feedback = type == GRAPH_DELAY ? DELAY_FEEDBACK : 0.0f;
+    return desc->node_count++;
+}
+
+bool graph_connect(GraphDesc *desc, int node, int input)
+{
+    if (node < 0 || node >= desc->node_count || input < 0 || input >= desc->node_count)
+        return false;
+
+    GraphNode *target = &desc->nodes[node];
+    if (target->input_count == max_inputs[target->type])
+        return false;
+    target->inputs[target->input_count++] = (Uint8)input;
+    return true;
+}
+
+// Next word of a statement into `token`, "=" on its own and a quoted string
+// with its opening quote. Returns false at the end of the statement and
+// leaves `text` on the separator.
+static bool next_token(const char **text, char *token, size_t size)
+{
+    const char *s = *text;
+    size_t length = 0;
+
+    while (*s == ' ' || *s == '\t' || *s == '\r')
+        s++;
+    if (*s == '\0' || *s == ';' || *s == '\n' || *s == '#')
+    {
+        *text = s;
+        return false;
+    }
+
+    if (*s == '=')
+        token[length++] = *s++;
+    else if (*s == '"')
+    {
+        token[length++] = *s++;
+        while (*s && *s != '"' && *s != '\n')
+        {
+            if (length + 1 < size)
+                token[length++] = *s;
+            s++;
+        }
+        if (*s == '"')
+            s++;
+    }
+    else
+        while (*s && !SDL_strchr(" \t\r;\n#=", *s))
+        {
+            if (length + 1 < size)
+                token[length++] = *s;
+            s++;
+        }
+    token[length] = '\0';
+    *text = s;
+    return true;
+}
+
+bool graph_parse(GraphDesc *desc, const char *text)
+{
+    // Input names wait until every node is known, so any order works
+    char names[GRAPH_MAX_NODES][GRAPH_MAX_INPUTS][GRAPH_NAME_LENGTH];
+    int statement = 0;
+
+    graph_desc_init(desc);
+    while (*text)
+    {
+        char name[STATEMENT_LENGTH], equals[STATEMENT_LENGTH], type_name[STATEMENT_LENGTH], token[STATEMENT_LENGTH];
+        const char *error = NULL;
+
+        statement++;
+        if (next_token(&text, name, sizeof(name)))
+        {
+            int type = GRAPH_NODE_TYPES;
+            if (next_token(&text, equals, sizeof(equals)) && SDL_strcmp(equals, "=") == 0 &&
+                next_token(&text, type_name, sizeof(type_name)))
+            {
+                for (type = GRAPH_OSC; type < GRAPH_NODE_TYPES; type++)
+                    if (SDL_strcmp(type_name, type_names[type]) == 0)
+                        break;
+            }
+
+            int node = type < GRAPH_NODE_TYPES ? graph_add(desc, name, type, default_values[type]) : -1;
+            if (type == GRAPH_NODE_TYPES)
+                error = "expected NAME = TYPE";
+            else if (node < 0)
+                error = "duplicate or invalid name, or too many nodes";
+
+            int values = 0;
+            while (!error && next_token(&text, token, sizeof(token)))
+            {
+                GraphNode *added = &desc->nodes[node];
+                char *end;
+                double value = SDL_strtod(token, &end);
+                if (token[0] == '"')
+                {
+                    if (added->type == GRAPH_REVERB)
+                        SDL_strlcpy(added->path, token + 1, GRAPH_PATH_LENGTH);
+                    else
+                        error = "only a reverb takes a path";
+                }
+                else if (end != token && *end == '\0')
+                {
+                    // A delay's second number is its feedback
+                    if (values++ > 0 && added->type == GRAPH_DELAY)
+                        added->feedback = (float)value;
+                    else
+                        added->value = (float)value;
+                }
+                else if (added->input_count == max_inputs[added->type] || SDL_strlen(token) >= GRAPH_NAME_LENGTH)
+                    error = "too many inputs";
+                else
+                    SDL_strlcpy(names[node][added->input_count++], token, GRAPH_NAME_LENGTH);
+            }
+        }
+
+        if (error)
+        {
+            SDL_Log("Graph statement %d: %s", statement, error);
+            return false;
+        }
+
+        // Past the comment and the separator
+        if (*text == '#')
+            while (*text && *text != '\n')
+                text++;
+        if (*text)
+            text++;
+    }
+
+    for (int n = 1; n < desc->node_count; n++)
+    {
+        GraphNode *node = &desc->nodes[n];
+        for (int i = 0; i < node->input_count; i++)
+        {
+            int input = graph_find(desc, names[n][i]);
+            if (input < 0)
+            {
+                SDL_Log("Graph node %s: no node called %s", node->name, names[n][i]);
+                return false;
+            }
+            node->inputs[i] = (Uint8)input;
+        }
+    }
+
+    desc->output = graph_find(desc, "out");
+    if (desc->output < 0)
+    {
+        SDL_Log("Graph has no node called out");
+        return false;
+    }
+    return true;
+}
+
+// Depth first from the output, each node placed after its inputs. Nodes
+// the output does not depend on never make it into the order.
+static bool visit(const GraphDesc *desc, int n, Uint8 *mark, Uint8 *order, int *count)
+{
+    if (mark[n] == 2)
+        return true;
+    if (mark[n] == 1)
+        return false; // Back on the path here, a cycle
+
+    mark[n] = 1;
+    for (int i = 0; i < desc->nodes[n].input_count; i++)
+        if (!visit(desc, desc->nodes[n].inputs[i], mark, order, count))
+            return false;
+    mark[n] = 2;
+    order[(*count)++] = (Uint8)n;
+    return true;
+}
+
+static Uint32 node_key(const GraphNode *node)
+{
+    Uint32 hash = 2166136261u; // FNV-1a
+    for (const char *c = node->name; *c; c++)
+        hash = (hash ^ (Uint8)*c) * 16777619u;
+    for (const char *c = node->path; *c; c++)
+        hash = (hash ^ (Uint8)*c) * 16777619u;
+    return hash ^ node->type;
+}
+
+void graph_plan_free(GraphPlan *plan)
+{
+    if (plan)
+    {
+        for (int o = 0; o < plan->op_count; o++)
+        {
+            GraphState *state = &plan->ops[o].state;
+            SDL_free(state->ring);
+            if (state->reverb)
+            {
+                reverb_free(state->reverb);
+                SDL_free(state->reverb);
+            }
+        }
+        SDL_free(plan->buffers);
+        SDL_free(plan);
+    }
+}
+
+GraphPlan *graph_compile(const GraphDesc *desc, int sample_rate, int channels)
+{
+    Uint8 mark[GRAPH_MAX_NODES] = {0};
+    Uint8 order[GRAPH_MAX_NODES];
+    int count = 0;
+
+    if (desc->output < 0 || desc->output >= desc->node_count || !visit(desc, desc->output, mark, order, &count))
+    {
+        SDL_Log("Graph has a cycle");
+        return NULL;
+    }
+
+    // Position of the last op reading each signal, the output is read after all
+    int last_use[GRAPH_MAX_NODES];
+    for (int i = 0; i < count; i++)
+    {
+        const GraphNode *node = &desc->nodes[order[i]];
+        if (node->input_count < min_inputs[node->type] || node->input_count > max_inputs[node->type])
+        {
+            SDL_Log("Graph node %s needs %d to %d inputs", node->name, min_inputs[node->type], max_inputs[node->type]);
+            return NULL;
+        }
+        if (node->type == GRAPH_REVERB && node->path[0] == '\0')
+        {
+            SDL_Log("Graph node %s needs an impulse response path", node->name);
+            return NULL;
+        }
+        last_use[order[i]] = i;
+        for (int j = 0; j < node->input_count; j++)
+            last_use[node->inputs[j]] = i;
+    }
+    last_use[desc->output] = count;
+
+    GraphPlan *plan = SDL_calloc(1, sizeof(GraphPlan));
+    if (!plan)
+    {
+        SDL_Log("Out of memory for the graph");
+        return NULL;
+    }
+    plan->sample_rate = sample_rate;
+    plan->channels = channels;
+
+    // Slot of each node's signal. The voices are on the bus from the start,
+    // the bus is free for any other signal once they are done with.
+    Uint8 slot[GRAPH_MAX_NODES];
+    bool taken[GRAPH_SLOTS] = {false};
+    taken[GRAPH_BUS] = mark[GRAPH_VOICES] != 0;
+    slot[GRAPH_VOICES] = GRAPH_BUS;
+
+    for (int i = 0; i < count; i++)
+    {
+        const GraphNode *node = &desc->nodes[order[i]];
+        if (node->type == GRAPH_VOICES)
+            continue;
+
+        // Inputs read for the last time give up their slots first, so the
+        // result can reuse one and the op runs in place
+        for (int j = 0; j < node->input_count; j++)
+            if (last_use[node->inputs[j]] == i)
+                taken[slot[node->inputs[j]]] = false;
+
+        int out = 0;
+        while (taken[out])
+            out++;
+        taken[out] = true;
+        slot[order[i]] = (Uint8)out;
+        plan->buffer_count = SDL_max(plan->buffer_count, out);
+
+        GraphOp *op = &plan->ops[plan->op_count++];
+        op->type = node->type;
+        op->out = (Uint8)out;
+        op->input_count = node->input_count;
+        for (int j = 0; j < node->input_count; j++)
+            op->in[j] = slot[node->inputs[j]];
+        op->key = node_key(node);
+
+        double nyquist = sample_rate / 2.0;
+        switch (node->type)
+        {
+        case GRAPH_OSC:
+            op->increment = (Uint32)(SDL_clamp(node->value, 0.0, nyquist) / sample_rate * 4294967296.0);
+            plan->sounds_alone = true;
+            break;
+        case GRAPH_LOWPASS:
+        case GRAPH_HIGHPASS:
+            op->value = (float)(1.0 - exp(-2.0 * M_PI * SDL_clamp(node->value, 1.0, nyquist) / sample_rate));
+            break;
+        case GRAPH_GAIN:
+            op->value = node->value;
+            break;
+        case GRAPH_MIX:
+            // A mix writing over one of its inputs starts from that one
+            for (int j = 1; j < op->input_count; j++)
+                if (op->in[j] == out)
+                {
+                    op->in[j] = op->in[0];
+                    op->in[0] = (Uint8)out;
+                }
+            break;
+        case GRAPH_DELAY:
+            op->ring_frames = (int)(GRAPH_MAX_DELAY * sample_rate);
+            op->delay = (int)SDL_clamp(node->value * sample_rate, 1.0, op->ring_frames - 1.0);
+            op->feedback = SDL_clamp(node->feedback, -MAX_FEEDBACK, MAX_FEEDBACK);
+            op->state.ring = SDL_calloc((size_t)op->ring_frames * channels, sizeof(float));
+            if (!op->state.ring)
+            {
+                SDL_Log("Out of memory for the graph");
+                graph_plan_free(plan);
+                return NULL;
+            }
+            break;
+        case GRAPH_REVERB:
+            SDL_strlcpy(op->path, node->path, GRAPH_PATH_LENGTH);
+            break;
+        }
+    }
+    plan->output = slot[desc->output];
+
+    if (plan->buffer_count > 0)
+    {
+        plan->buffers = SDL_calloc((size_t)plan->buffer_count * BUS_STRIDE, sizeof(float));
+        if (!plan->buffers)
+        {
+            SDL_Log("Out of memory for the graph");
+            graph_plan_free(plan);
+            return NULL;
+        }
+    }
+    return plan;
+}
+
+void graph_init(Graph *graph)
+{
+    SDL_zerop(graph);
+}
+
+void graph_publish(Graph *graph, GraphPlan *plan)
+{
+    graph_plan_free(SDL_AtomicSetPtr(&graph->retired, NULL));
+
+    // Publish the plan before its pointer
+    SDL_MemoryBarrierRelease();
+    graph_plan_free(SDL_AtomicSetPtr(&graph->pending, plan)); // Replaced before the audio thread saw it
+}
+
+// Impulse responses of the reverbs, the slow part of a new plan
+static bool load_reverbs(GraphPlan *plan)
+{
+    for (int o = 0; o < plan->op_count; o++)
+    {
+        GraphOp *op = &plan->ops[o];
+        if (op->type != GRAPH_REVERB || op->state.reverb)
+            continue;
+
+        ReverbIr *ir = reverb_ir_load(op->path, plan->sample_rate);
+        if (!ir)
+            return false;
+        Reverb *reverb = SDL_malloc(sizeof(Reverb));
+        if (!reverb)
+            reverb_ir_release(ir);
+        if (!reverb || !reverb_init(reverb, ir, plan->channels))
+        {
+            SDL_free(reverb);
+            SDL_Log("Out of memory for the reverb on %s", op->path);
+            return false;
+        }
+        op->state.reverb = reverb;
+    }
+    return true;
+}
+
+static int build_main(void *data)
+{
+    Graph *graph = data;
+    GraphPlan *plan = graph->building;
+
+    graph->building = NULL;
+    if (load_reverbs(plan))
+        graph_publish(graph, plan);
+    else
+        graph_plan_free(plan);
+    return 0;
+}
+
+void graph_build(Graph *graph, GraphPlan *plan)
+{
+    // One build at a time, so publishing stays on one thread
+    if (graph->builder)
+        SDL_WaitThread(graph->builder, NULL);
+
+    graph->building = plan;
+    graph->builder = SDL_CreateThread(build_main, "graph build", graph);
+    if (!graph->builder)
+    {
+        SDL_Log("Error creating graph build thread: %s", SDL_GetError());
+        build_main(graph);
+    }
+}
+
+void graph_close(Graph *graph)
+{
+    if (graph->builder)
+        SDL_WaitThread(graph->builder, NULL);
+    graph->builder = NULL;
+    graph_plan_free(SDL_AtomicSetPtr(&graph->retired, NULL));
+    graph_plan_free(SDL_AtomicSetPtr(&graph->pending, NULL));
+    graph_plan_free(graph->current);
+    graph->current = NULL;
+}
+
+void graph_update(Graph *graph)
+{
+    // The retired slot holds one plan, keep the current one until the UI
+    // thread has freed the last
+    if (!SDL_AtomicGetPtr(&graph->pending) || (graph->current && SDL_AtomicGetPtr(&graph->retired)))
+        return;
+
+    GraphPlan *plan = SDL_AtomicSetPtr(&graph->pending, NULL);
+    SDL_MemoryBarrierAcquire();
+
+    // Nodes found again by name keep their phase, filter memory and tails:
+    // the buffers trade places, so nothing is allocated or freed here
+    GraphPlan *old = graph->current;
+    for (int i = 0; old && i < plan->op_count; i++)
+        for (int j = 0; j < old->op_count; j++)
+            if (old->ops[j].key == plan->ops[i].key)
+            {
+                GraphState state = plan->ops[i].state;
+                plan->ops[i].state = old->ops[j].state;
+                old->ops[j].state = state;
+                break;
+            }
+
+    graph->current = plan;
+    if (old)
+        SDL_AtomicSetPtr(&graph->retired, old);
+}
+
+bool graph_busy(Graph *graph)
+{
+    GraphPlan *plan = graph->current;
+    if (SDL_AtomicGetPtr(&graph->pending) || (plan && plan->sounds_alone))
+        return true;
+
+    for (int o = 0; plan && o < plan->op_count; o++)
+        if (plan->ops[o].state.ringing > 0)
+            return true;
+    return false;
+}
+
+static float *slot_buffer(const GraphPlan *plan, float *bus, int slot)
+{
+    return slot == GRAPH_BUS ? bus : plan->buffers + (size_t)(slot - 1) * BUS_STRIDE;
+}
+
+// One pole low or high pass, in place when `in` is `out`
+static void one_pole(float *out, const float *in, float coefficient, float *memory, bool highpass, int frames)
+{
+    float z = *memory;
+
+    for (int i = 0; i < frames; i++)
+    {
+        float x = in[i];
+        z += coefficient * (x - z);
+        out[i] = highpass ? x - z : z;
+    }
+    *memory = fabsf(z) < FILTER_SILENCE ? 0.0f : z;
+}
+
+// Feedback delay on one ring shared by the channels, interleaved: each frame
+// reads the echo `delay` frames back and writes the input plus the echo
+static void delay_process(GraphOp *op, float *out, const float *in, int channels, int frames)
+{
+    float *ring = op->state.ring;
+    int write = op->state.position;
+    int read = write >= op->delay ? write - op->delay : write - op->delay + op->ring_frames;
+    bool loud = false;
+
+    for (int i = 0; i < frames; i++)
+    {
+        float *written = ring + (size_t)write * channels;
+        const float *echo = ring + (size_t)read * channels;
+        for (int c = 0; c < channels; c++)
+        {
+            float y = echo[c];
+            float w = in[c * SYNTH_BLOCK_SIZE + i] + op->feedback * y;
+            written[c] = fabsf(w) < FILTER_SILENCE ? 0.0f : w;
+            out[c * SYNTH_BLOCK_SIZE + i] = y;
+            loud |= fabsf(w) >= TAIL_SILENCE;
+        }
+        if (++write == op->ring_frames)
+            write = 0;
+        if (++read == op->ring_frames)
+            read = 0;
+    }
+    op->state.position = write;
+
+    // What was written comes back out for `delay` frames
+    op->state.ringing = loud ? op->delay + frames : SDL_max(op->state.ringing - frames, 0);
+}
+
+static float block_peak(const float *planar, int channels, int frames)
+{
+    float peak = 0.0f;
+
+    for (int c = 0; c < channels; c++)
+        for (int i = 0; i < frames; i++)
+            peak = SDL_max(peak, fabsf(planar[c * SYNTH_BLOCK_SIZE + i]));
+    return peak;
+}
+
+// The wet signal trails the input by up to two partitions, then rings for
+// as long as the output stays above silence
+static void reverb_op_process(GraphOp *op, float *out, const float *in, int channels, int frames)
+{
+    bool fed = block_peak(in, channels, frames) >= TAIL_SILENCE;
+
+    reverb_process(op->state.reverb, out, in, SYNTH_BLOCK_SIZE, frames);
+    if (fed || block_peak(out, channels, frames) >= TAIL_SILENCE)
+        op->state.ringing = 2 * REVERB_PARTITION;
+    else
+        op->state.ringing = SDL_max(op->state.ringing - frames, 0);
+}
+
+void graph_process(Graph *graph, const Synth *synth, float *bus, int frames)
+{
+    GraphPlan *plan = graph->current;
+    if (!plan)
+        return;
+
+    const SynthKernels *k = synth->kernels;
+    int channels = synth->channels;
+    size_t bytes = frames * sizeof(float);
+
+    for (int o = 0; o < plan->op_count; o++)
+    {
+        GraphOp *op = &plan->ops[o];
+        float *out = slot_buffer(plan, bus, op->out);
+        const float *in = op->input_count ? slot_buffer(plan, bus, op->in[0]) : NULL;
+
+        switch (op->type)
+        {
+        case GRAPH_OSC:
+            SDL_memset(out, 0, bytes);
+            op->state.phase = k->render_voice(out, op->state.phase, op->increment, SYNTH_VOICE_GAIN, 0.0f, frames);
+            for (int c = 1; c < channels; c++)
+                SDL_memcpy(out + c * SYNTH_BLOCK_SIZE, out, bytes);
+            break;
+        case GRAPH_LOWPASS:
+        case GRAPH_HIGHPASS:
+            for (int c = 0; c < channels; c++)
+                one_pole(out + c * SYNTH_BLOCK_SIZE, in + c * SYNTH_BLOCK_SIZE, op->value, &op->state.z[c],
+                         op->type == GRAPH_HIGHPASS, frames);
+            break;
+        case GRAPH_GAIN:
+        {
+            // A changed gain ramps over the block, a new node fades in
+            float start = op->state.level;
+            float step = (op->value - start) / frames;
+            for (int c = 0; c < channels; c++)
+            {
+                float *dst = out + c * SYNTH_BLOCK_SIZE;
+                const float *src = in + c * SYNTH_BLOCK_SIZE;
+                for (int i = 0; i < frames; i++)
+                    dst[i] = src[i] * (start + step * i);
+            }
+            op->state.level = op->value;
+            break;
+        }
+        case GRAPH_MIX:
+            for (int c = 0; c < channels; c++)
+            {
+                float *dst = out + c * SYNTH_BLOCK_SIZE;
+                if (in != out)
+                    SDL_memcpy(dst, in + c * SYNTH_BLOCK_SIZE, bytes);
+                for (int j = 1; j < op->input_count; j++)
+                    k->accumulate(dst, slot_buffer(plan, bus, op->in[j]) + c * SYNTH_BLOCK_SIZE, 1.0f, frames);
+            }
+            break;
+        case GRAPH_DELAY:
+            delay_process(op, out, in, plan->channels, frames);
+            break;
+        case GRAPH_REVERB:
+            if (op->state.reverb)
+                reverb_op_process(op, out, in, channels, frames);
+            else
+                for (int c = 0; c < channels; c++)
+                    SDL_memset(out + c * SYNTH_BLOCK_SIZE, 0, bytes);
+            break;
+        }
+    }
+
+    if (plan->output != GRAPH_BUS)
+    {
+        const float *result = slot_buffer(plan, bus, plan->output);
+        for (int c = 0; c < channels; c++)
+            SDL_memcpy(bus + c * SYNTH_BLOCK_SIZE, result + c * SYNTH_BLOCK_SIZE, bytes);
+    }
+}
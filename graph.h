@@ -0,0 +1,165 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <SDL.h>
+#include <stdbool.h>
+
+#include "synth.h"
+
+#define GRAPH_MAX_NODES 32
+#define GRAPH_MAX_INPUTS 4
+#define GRAPH_NAME_LENGTH 16
+#define GRAPH_BUS 0 // Buffer slot 0 is the synth's mix bus itself
+#define GRAPH_PATH_LENGTH 256
+#define GRAPH_MAX_DELAY 2.0 // Seconds of ring buffer behind each delay
+
+enum
+{
+    GRAPH_VOICES = 0, // The voices as mixed on the bus, always node 0
+    GRAPH_OSC,        // Sine at `value` Hz, at the level of one voice
+    GRAPH_LOWPASS,    // One pole, cutoff at `value` Hz
+    GRAPH_HIGHPASS,
+    GRAPH_GAIN, // Input times `value`
+    GRAPH_MIX,  // Sum of the inputs
+    GRAPH_DELAY,  // Input `value` seconds ago, fed back by `feedback`, the wet signal only
+    GRAPH_REVERB, // Input convolved with the impulse response at `path`, the wet signal only
+    GRAPH_NODE_TYPES
+};
+
+typedef struct GraphNode
+{
+    char name[GRAPH_NAME_LENGTH];
+    Uint8 type;
+    Uint8 input_count;
+    Uint8 inputs[GRAPH_MAX_INPUTS]; // Node indices
+    float value;
+    float feedback;
+    char path[GRAPH_PATH_LENGTH];
+} GraphNode;
+
+// Graph as the UI thread edits it. Nodes can be added and connected in any
+// order, graph_compile() sorts them out.
+typedef struct GraphDesc
+{
+    GraphNode nodes[GRAPH_MAX_NODES];
+    int node_count;
+    int output; // Node whose signal goes on to the output stage
+} GraphDesc;
+
+struct Reverb;
+
+// Node state that carries over from one plan to the next. Plans swap it
+// rather than copy it, so a delay or reverb keeps its tail and whichever
+// plan is freed takes the other buffers with it.
+typedef struct GraphState
+{
+    Uint32 phase;
+    float z[SYNTH_MAX_CHANNELS];
+    float level;           // Gain reached, a new value ramps from here
+    int position;          // Write frame in the ring
+    int ringing;           // Delay or reverb: frames its tail may still sound above silence
+    float *ring;           // Delay, frames of interleaved channels
+    struct Reverb *reverb; // Reverb, loaded by graph_build()
+} GraphState;
+
+// One node's process call with everything resolved: the buffer slots it
+// reads and writes and its coefficients at the plan's sample rate
+typedef struct GraphOp
+{
+    Uint8 type;
+    Uint8 out;
+    Uint8 input_count;
+    Uint8 in[GRAPH_MAX_INPUTS];
+    Uint32 key; // Hash of the name, type and path, finds the node again in the next plan
+    float value;
+    float feedback;
+    Uint32 increment;
+    int delay;      // Frames
+    int ring_frames;
+    char path[GRAPH_PATH_LENGTH];
+    GraphState state;
+} GraphOp;
+
+// Compiled graph: the reachable nodes in dependency order, each buffer slot
+// reused once the last reader of its signal has run. The audio thread only
+// walks the ops, it never looks at the description.
+typedef struct GraphPlan
+{
+    int op_count;
+    int output;        // Slot of the result
+    bool sounds_alone; // An oscillator plays with no voice sounding
+    int sample_rate;
+    int channels;
+    int buffer_count;  // Slots besides the bus
+    float *buffers;    // Planar like the bus, SYNTH_MAX_CHANNELS * SYNTH_BLOCK_SIZE per slot
+    GraphOp ops[GRAPH_MAX_NODES];
+} GraphPlan;
+
+// Hand-over between the UI and the audio thread. A new plan is published
+// by swapping the pending pointer; the audio thread takes it at the start
+// of a render call and puts the plan it drops in the retired slot, which
+// the UI thread empties and frees. The audio thread never frees anything.
+typedef struct Graph
+{
+    void *pending;       // GraphPlan not picked up yet
+    void *retired;       // GraphPlan the audio thread let go of
+    GraphPlan *current;  // Audio thread
+    SDL_Thread *builder; // graph_build() in progress
+    GraphPlan *building;
+} Graph;
+
+// A graph of just the voices going to the output
+void graph_desc_init(GraphDesc *desc);
+
+// Index of the node called `name`, -1 if there is none
+int graph_find(const GraphDesc *desc, const char *name);
+
+// Add a node and return its index, -1 when the name is taken or too long or
+// the graph is full
+int graph_add(GraphDesc *desc, const char *name, int type, float value);
+bool graph_connect(GraphDesc *desc, int node, int input);
+
+// Build the nodes from `text`, statements separated by ';' or new lines:
+// "NAME = TYPE INPUT... [VALUE]", TYPE one of osc, lowpass, highpass, gain,
+// mix, delay or reverb, "voices" the voice bus and "out" the node sent to
+// the output. Inputs may be defined later in the text, VALUE defaults to
+// 440 Hz, 1000 Hz, 100 Hz and 1 for the first four. A delay takes the time
+// in seconds and the feedback, 0.25 and 0.35 by default, and a reverb the
+// impulse response as a quoted WAV path. '#' starts a comment.
+bool graph_parse(GraphDesc *desc, const char *text);
+
+// UI thread: sort and allocate a plan for `desc`, NULL with the reason
+// logged when it has a cycle or a node with the wrong inputs. Reverbs are
+// left without their impulse response, graph_build() loads it.
+GraphPlan *graph_compile(const GraphDesc *desc, int sample_rate, int channels);
+
+// A plan that was never published, with the buffers and tails it holds
+void graph_plan_free(GraphPlan *plan);
+
+void graph_init(Graph *graph);
+
+// UI thread: hand `plan` over, it takes effect at the next render call.
+// Frees the plan retired by the previous one. Not while a build runs.
+void graph_publish(Graph *graph, GraphPlan *plan);
+
+// UI thread: load the impulse responses of `plan` on a background thread
+// and publish it once they are transformed; a plan whose loading fails is
+// dropped and the graph playing carries on. Waits for the previous build.
+void graph_build(Graph *graph, GraphPlan *plan);
+
+// Once the audio thread is stopped, after waiting for a build
+void graph_close(Graph *graph);
+
+// Audio thread, start of a render call: pick up a published plan
+void graph_update(Graph *graph);
+
+// Audio thread: true when the graph makes sound of its own, so the synth
+// must keep rendering without voices: an oscillator, a new plan, or a delay
+// or reverb tail still above silence
+bool graph_busy(Graph *graph);
+
+// Audio thread: run the plan over one block of the planar `bus`, which holds
+// the mixed voices and gets the graph's output in their place
+void graph_process(Graph *graph, const Synth *synth, float *bus, int frames);
+
+#endif
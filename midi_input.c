@@ -0,0 +1,277 @@
+#include "midi_input.h"
+
+#include <SDL.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <mmsystem.h>
+#elif defined(HAVE_ALSA)
+#include <alsa/asoundlib.h>
+#include <poll.h>
+#endif
+
+#define MIDI_POLL_MS 100 // How often the input thread checks for shutdown
+
+static EventFanout *midi_targets = NULL;
+static void (*midi_wake)(void) = NULL;
+static int midi_dropped = 0;
+
+static void signal_wake(void);
+
+// Decode one channel voice message, all channels are accepted
+static void push_message(Uint8 status, Uint8 data1, Uint8 data2, Uint64 time)
+{
+    SynthEvent event;
+    SDL_zero(event);
+
+    switch (status & 0xF0)
+    {
+    case 0x80:
+        event.type = EVENT_NOTE_OFF;
+        break;
+    case 0x90:
+        event.type = EVENT_NOTE_ON; // Velocity 0 is handled as note off by the synth
+        break;
+    case 0xB0:
+        event.type = EVENT_CONTROL;
+        break;
+    default:
+        return;
+    }
+
+    event.time = time;
+    event.note = data1 & 0x7F;
+    event.value = data2 & 0x7F;
+    signal_wake();
+    if (!event_fanout_push(midi_targets, &event))
+        midi_dropped++;
+}
+
+#if !defined(_WIN32)
+
+// Our own input thread runs `wake` directly
+static void signal_wake(void)
+{
+    if (midi_wake)
+        midi_wake();
+}
+
+#endif
+
+#if defined(_WIN32)
+
+// WinMM delivers input on its own driver thread through this callback. It
+// may not call other system or multimedia functions without risking a
+// deadlock, so it only queues the event and signals our wake thread, which
+// calls `wake` (that pauses and resumes devices) on its behalf.
+static HMIDIIN midi_handle = NULL;
+static HANDLE midi_signal = NULL; // Auto-reset event, set by the callback
+static SDL_Thread *midi_thread = NULL;
+static SDL_atomic_t midi_running;
+
+static void signal_wake(void)
+{
+    SetEvent(midi_signal);
+}
+
+static int midi_wake_main(void *data)
+{
+    (void)data;
+    while (SDL_AtomicGet(&midi_running))
+        if (WaitForSingleObject(midi_signal, MIDI_POLL_MS) == WAIT_OBJECT_0 && midi_wake)
+            midi_wake();
+    return 0;
+}
+
+static void CALLBACK midi_in_proc(HMIDIIN handle, UINT message, DWORD_PTR instance, DWORD_PTR param1, DWORD_PTR param2)
+{
+    (void)handle;
+    (void)instance;
+    (void)param2;
+
+    if (message == MIM_DATA)
+        push_message((Uint8)param1, (Uint8)(param1 >> 8), (Uint8)(param1 >> 16), SDL_GetPerformanceCounter());
+}
+
+bool midi_input_open(EventFanout *targets, const char *port, void (*wake)(void))
+{
+    UINT device = port ? (UINT)SDL_atoi(port) : 0;
+
+    if (device >= midiInGetNumDevs())
+    {
+        SDL_Log("MIDI: no input device %u (%u available)", device, midiInGetNumDevs());
+        return false;
+    }
+
+    midi_targets = targets;
+    midi_wake = wake;
+    midi_signal = CreateEvent(NULL, FALSE, FALSE, NULL);
+    SDL_AtomicSet(&midi_running, 1);
+    midi_thread = midi_signal ? SDL_CreateThread(midi_wake_main, "midi wake", NULL) : NULL;
+    if (!midi_thread)
+    {
+        SDL_Log("MIDI: cannot create wake thread: %s", SDL_GetError());
+        midi_input_close();
+        return false;
+    }
+    if (midiInOpen(&midi_handle, device, (DWORD_PTR)midi_in_proc, 0, CALLBACK_FUNCTION) != MMSYSERR_NOERROR)
+    {
+        SDL_Log("MIDI: cannot open input device %u", device);
+        midi_handle = NULL;
+        midi_input_close();
+        return false;
+    }
+    midiInStart(midi_handle);
+    SDL_Log("MIDI: listening on input device %u", device);
+    return true;
+}
+
+void midi_input_close(void)
+{
+    // No more callbacks once the device is closed, then the wake thread can go
+    if (midi_handle)
+    {
+        midiInStop(midi_handle);
+        midiInReset(midi_handle);
+        midiInClose(midi_handle);
+        midi_handle = NULL;
+    }
+    if (midi_thread)
+    {
+        SDL_AtomicSet(&midi_running, 0);
+        SDL_WaitThread(midi_thread, NULL);
+        midi_thread = NULL;
+    }
+    if (midi_signal)
+    {
+        CloseHandle(midi_signal);
+        midi_signal = NULL;
+    }
+    if (midi_dropped)
+        SDL_Log("MIDI: %d events dropped, event queue full", midi_dropped);
+}
+
+#elif defined(HAVE_ALSA)
+
+static snd_seq_t *midi_seq = NULL;
+static SDL_Thread *midi_thread = NULL;
+static SDL_atomic_t midi_running;
+
+static int midi_thread_main(void *data)
+{
+    struct pollfd fds[4];
+    int count = snd_seq_poll_descriptors(midi_seq, fds, SDL_arraysize(fds), POLLIN);
+
+    (void)data;
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+
+    while (SDL_AtomicGet(&midi_running))
+    {
+        if (poll(fds, count, MIDI_POLL_MS) <= 0)
+            continue;
+
+        // Stamp the whole batch at wakeup, before decoding costs anything
+        Uint64 time = SDL_GetPerformanceCounter();
+        snd_seq_event_t *ev;
+        int result;
+
+        while ((result = snd_seq_event_input(midi_seq, &ev)) >= 0 || result == -ENOSPC)
+        {
+            if (result < 0)
+                continue; // Kernel queue overrun, events were lost but keep reading
+
+            switch (ev->type)
+            {
+            case SND_SEQ_EVENT_NOTEON:
+                push_message(0x90, ev->data.note.note, ev->data.note.velocity, time);
+                break;
+            case SND_SEQ_EVENT_NOTEOFF:
+                push_message(0x80, ev->data.note.note, 0, time);
+                break;
+            case SND_SEQ_EVENT_CONTROLLER:
+                push_message(0xB0, (Uint8)ev->data.control.param, (Uint8)ev->data.control.value, time);
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+bool midi_input_open(EventFanout *targets, const char *port, void (*wake)(void))
+{
+    int my_port;
+
+    if (snd_seq_open(&midi_seq, "default", SND_SEQ_OPEN_INPUT, SND_SEQ_NONBLOCK) < 0)
+    {
+        SDL_Log("MIDI: cannot open the ALSA sequencer");
+        midi_seq = NULL;
+        return false;
+    }
+
+    snd_seq_set_client_name(midi_seq, "rosegarden synth");
+    my_port = snd_seq_create_simple_port(midi_seq, "input",
+                                         SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE,
+                                         SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+    if (my_port < 0)
+    {
+        SDL_Log("MIDI: cannot create sequencer port");
+        snd_seq_close(midi_seq);
+        midi_seq = NULL;
+        return false;
+    }
+
+    if (port)
+    {
+        snd_seq_addr_t source;
+        if (snd_seq_parse_address(midi_seq, &source, port) < 0 ||
+            snd_seq_connect_from(midi_seq, my_port, source.client, source.port) < 0)
+            SDL_Log("MIDI: cannot connect from %s, use aconnect", port);
+    }
+
+    midi_targets = targets;
+    midi_wake = wake;
+    SDL_AtomicSet(&midi_running, 1);
+    midi_thread = SDL_CreateThread(midi_thread_main, "midi input", NULL);
+    if (!midi_thread)
+    {
+        SDL_Log("MIDI: cannot create input thread: %s", SDL_GetError());
+        snd_seq_close(midi_seq);
+        midi_seq = NULL;
+        return false;
+    }
+
+    SDL_Log("MIDI: listening on ALSA port %d:%d", snd_seq_client_id(midi_seq), my_port);
+    return true;
+}
+
+void midi_input_close(void)
+{
+    if (!midi_seq)
+        return;
+
+    SDL_AtomicSet(&midi_running, 0);
+    SDL_WaitThread(midi_thread, NULL);
+    midi_thread = NULL;
+    snd_seq_close(midi_seq);
+    midi_seq = NULL;
+    if (midi_dropped)
+        SDL_Log("MIDI: %d events dropped, event queue full", midi_dropped);
+}
+
+#else
+
+bool midi_input_open(EventFanout *targets, const char *port, void (*wake)(void))
+{
+    (void)targets;
+    (void)port;
+    (void)wake;
+    (void)push_message;
+    SDL_Log("MIDI: input is not supported in this build");
+    return false;
+}
+
+void midi_input_close(void)
+{
+}
+
+#endif
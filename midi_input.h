@@ -0,0 +1,22 @@
+#ifndef MIDI_INPUT_H
+#define MIDI_INPUT_H
+
+#include <stdbool.h>
+
+#include "event_queue.h"
+
+// MIDI input on its own thread. Note on/off and control change messages are
+// stamped with the performance counter as they arrive and pushed into every
+// queue of `targets`, which the audio threads drain at sample-accurate
+// offsets.
+//
+// Backends: ALSA sequencer on Linux (built when ALSA is found), WinMM on
+// Windows. `port` picks the source: an ALSA "client:port" to connect from
+// (NULL leaves our port for aconnect or a patchbay), or a WinMM device
+// index (NULL for the first device). `wake` is called from the input thread
+// before each event is queued, e.g. to resume a paused device; WinMM's
+// callback may not do that, there a wake thread calls it right after.
+bool midi_input_open(EventFanout *targets, const char *port, void (*wake)(void));
+void midi_input_close(void);
+
+#endif
@@ -0,0 +1,275 @@
+#include "offline.h"
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "synth.h"
+#include "wav.h"
+
+#define OFFLINE_BLOCK 65536 // Frames rendered and written per pass
+#define OFFLINE_TAIL 1.0    // Seconds rendered after the last event without an end line
+
+typedef struct ScriptEvent
+{
+    Uint64 frame;
+    int order; // Position in the file, keeps the sort stable
+    SynthEvent event;
+} ScriptEvent;
+
+typedef struct Script
+{
+    ScriptEvent *events;
+    int count;
+    int capacity;
+    Uint64 end_frame;
+} Script;
+
+static int compare_events(const void *a, const void *b)
+{
+    const ScriptEvent *x = a, *y = b;
+    if (x->frame != y->frame)
+        return x->frame < y->frame ? -1 : 1;
+    // Same frame: keep file order so "off" then "on" retriggers
+    return x->order - y->order;
+}
+
+static bool add_event(Script *script, Uint64 frame, Uint8 type, int note)
+{
+    if (script->count == script->capacity)
+    {
+        int capacity = script->capacity ? script->capacity * 2 : 64;
+        ScriptEvent *events = SDL_realloc(script->events, capacity * sizeof(ScriptEvent));
+        if (!events)
+            return false;
+        script->events = events;
+        script->capacity = capacity;
+    }
+
+    ScriptEvent *e = &script->events[script->count++];
+    SDL_zerop(e);
+    e->frame = frame;
+    e->order = script->count - 1;
+    e->event.type = type;
+    e->event.note = (Uint8)note;
+    e->event.value = 127;
+    return true;
+}
+
+static bool load_script(Script *script, const char *path, int sample_rate)
+{
+    FILE *file = fopen(path, "r");
+    char line[256];
+    int line_number = 0;
+    bool has_end = false;
+
+    SDL_zerop(script);
+    if (!file)
+    {
+        SDL_Log("Cannot open note script %s", path);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file))
+    {
+        double seconds;
+        char command[16];
+        int note = 0;
+        int fields;
+
+        line_number++;
+        char *comment = SDL_strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        fields = sscanf(line, "%lf %15s %d", &seconds, command, &note);
+        if (fields <= 0)
+            continue; // Blank line
+
+        Uint64 frame = (Uint64)(seconds * sample_rate + 0.5);
+        bool ok = fields >= 2 && seconds >= 0.0;
+        if (ok && SDL_strcmp(command, "end") == 0)
+        {
+            script->end_frame = frame;
+            has_end = true;
+        }
+        else if (ok && fields == 3 && note >= 0 && note < 128)
+        {
+            if (SDL_strcmp(command, "on") == 0)
+                ok = add_event(script, frame, EVENT_NOTE_ON, note);
+            else if (SDL_strcmp(command, "off") == 0)
+                ok = add_event(script, frame, EVENT_NOTE_OFF, note);
+            else
+                ok = false;
+        }
+        else
+        {
+            ok = false;
+        }
+
+        if (!ok)
+        {
+            SDL_Log("%s:%d: bad script line", path, line_number);
+            fclose(file);
+            SDL_free(script->events);
+            return false;
+        }
+    }
+    fclose(file);
+
+    if (script->count > 0)
+        qsort(script->events, script->count, sizeof(ScriptEvent), compare_events);
+
+    if (!has_end)
+    {
+        Uint64 last = script->count ? script->events[script->count - 1].frame : 0;
+        script->end_frame = last + (Uint64)(OFFLINE_TAIL * sample_rate);
+    }
+    return true;
+}
+
+bool offline_render(const char *script_path, const char *wav_path, int sample_rate, int channels, float amplitude)
+{
+    Script script;
+    WavWriter wav;
+
+    if (!load_script(&script, script_path, sample_rate))
+        return false;
+
+    Synth *synth = SDL_malloc(sizeof(Synth));
+    Sint16 *block = SDL_malloc(OFFLINE_BLOCK * channels * sizeof(Sint16));
+    bool ok = synth && block && wav_open(&wav, wav_path, sample_rate, channels);
+    if (!ok)
+    {
+        SDL_Log("Cannot write %s", wav_path);
+        SDL_free(block);
+        SDL_free(synth);
+        SDL_free(script.events);
+        return false;
+    }
+
+    synth_init(synth, sample_rate, amplitude);
+    synth_set_output(synth, AUDIO_S16SYS, channels, false);
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint64 frame = 0;
+    int next = 0;
+
+    while (ok && frame < script.end_frame)
+    {
+        Uint64 remaining = script.end_frame - frame;
+        int length = remaining < OFFLINE_BLOCK ? (int)remaining : OFFLINE_BLOCK;
+        int pos = 0;
+
+        // Same synthesis path as the callback, with events applied on the exact frame
+        while (pos < length)
+        {
+            while (next < script.count && script.events[next].frame <= frame + pos)
+                synth_apply_event(synth, &script.events[next++].event);
+
+            int run = length - pos;
+            if (next < script.count && script.events[next].frame < frame + length)
+                run = (int)(script.events[next].frame - (frame + pos));
+
+            synth_render(synth, block + pos * channels, run);
+            pos += run;
+        }
+
+        ok = wav_write(&wav, block, length * channels);
+        frame += length;
+    }
+
+    ok = wav_close(&wav) && ok;
+
+    double elapsed = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    double seconds = (double)frame / sample_rate;
+    if (ok)
+        SDL_Log("Rendered %.2f s of audio to %s in %.3f s (%.0fx real-time)", seconds, wav_path, elapsed,
+                elapsed > 0.0 ? seconds / elapsed : 0.0);
+    else
+        SDL_Log("Error writing %s", wav_path);
+
+    SDL_free(block);
+    SDL_free(synth);
+    SDL_free(script.events);
+    return ok;
+}
+
+static FILE *open_render(const char *path, WavInfo *info)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file || !wav_read_info(file, info) || info->is_float || fseek(file, info->data_offset, SEEK_SET) != 0)
+    {
+        SDL_Log("Cannot read %s, expected a 16-bit WAV file", path);
+        if (file)
+            fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+bool offline_compare(const char *wav_path, const char *golden_path, int tolerance)
+{
+    WavInfo info, golden_info;
+    FILE *file = open_render(wav_path, &info);
+    FILE *golden = file ? open_render(golden_path, &golden_info) : NULL;
+    if (!golden)
+    {
+        if (file)
+            fclose(file);
+        return false;
+    }
+
+    bool ok = info.sample_rate == golden_info.sample_rate && info.channels == golden_info.channels &&
+              info.frames == golden_info.frames;
+    if (!ok)
+        SDL_Log("%s: %d Hz, %d channels, %u frames, golden %s has %d Hz, %d channels, %u frames", wav_path,
+                info.sample_rate, info.channels, (unsigned)info.frames, golden_path, golden_info.sample_rate,
+                golden_info.channels, (unsigned)golden_info.frames);
+
+    Sint16 *a = SDL_malloc(OFFLINE_BLOCK * sizeof(Sint16));
+    Sint16 *b = SDL_malloc(OFFLINE_BLOCK * sizeof(Sint16));
+    Uint64 total = (Uint64)info.frames * info.channels, done = 0, over = 0, first_over = 0;
+    int largest = 0;
+    if (ok && (!a || !b))
+    {
+        SDL_Log("Out of memory comparing %s", wav_path);
+        ok = false;
+    }
+
+    while (ok && done < total)
+    {
+        size_t count = (size_t)SDL_min(total - done, (Uint64)OFFLINE_BLOCK);
+        if (fread(a, sizeof(Sint16), count, file) != count || fread(b, sizeof(Sint16), count, golden) != count)
+        {
+            SDL_Log("Truncated data comparing %s to %s", wav_path, golden_path);
+            ok = false;
+            break;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            int difference = SDL_abs((Sint16)SDL_SwapLE16(a[i]) - (Sint16)SDL_SwapLE16(b[i]));
+            largest = SDL_max(largest, difference);
+            if (difference > tolerance && over++ == 0)
+                first_over = done + i;
+        }
+        done += count;
+    }
+
+    if (ok)
+    {
+        SDL_Log("Compared %s to %s: largest difference %d, tolerance %d", wav_path, golden_path, largest, tolerance);
+        if (over > 0)
+        {
+            SDL_Log("%llu samples over the tolerance, the first at %.4f s on channel %d", (unsigned long long)over,
+                    (double)(first_over / info.channels) / info.sample_rate, (int)(first_over % info.channels));
+            ok = false;
+        }
+    }
+
+    SDL_free(a);
+    SDL_free(b);
+    fclose(file);
+    fclose(golden);
+    return ok;
+}
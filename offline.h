@@ -0,0 +1,22 @@
+#ifndef OFFLINE_H
+#define OFFLINE_H
+
+#include <stdbool.h>
+
+// Headless render: play the note script at `script_path` through the synth
+// and write the result to `wav_path`, with no window and no audio device.
+//
+// Script lines are "<seconds> on <note>", "<seconds> off <note>" or
+// "<seconds> end", where note is a MIDI note number. '#' starts a comment.
+// Without an end line the render stops one second after the last event.
+// The WAV file has `channels` interleaved 16-bit channels.
+bool offline_render(const char *script_path, const char *wav_path, int sample_rate, int channels, float amplitude);
+
+// Regression check of a render against a golden file kept from an earlier
+// one: both must be 16-bit WAV files of the same rate, layout and length,
+// and no sample may differ by more than `tolerance` (in 16-bit steps, the
+// SIMD kernels round slightly differently from the scalar ones). Logs the
+// largest difference, and where the first one over the tolerance is.
+bool offline_compare(const char *wav_path, const char *golden_path, int tolerance);
+
+#endif
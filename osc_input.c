@@ -0,0 +1,376 @@
+// recvmmsg() is a GNU extension
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "osc_input.h"
+
+#include <SDL.h>
+#include <string.h>
+
+#include "synth.h"
+
+#if defined(_WIN32)
+#include <winsock2.h>
+typedef SOCKET OscSocket;
+#define NO_SOCKET INVALID_SOCKET
+#define close_socket closesocket
+#else
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int OscSocket;
+#define NO_SOCKET (-1)
+#define close_socket close
+#endif
+
+#define OSC_POLL_MS 100 // How often the input thread checks for shutdown
+#define OSC_BATCH 32    // Datagrams taken per receive call
+#define OSC_MAX_PACKET 1536
+#define OSC_MAX_DEPTH 4 // Bundles nested deeper are ignored
+#define OSC_RECEIVE_BUFFER (256 << 10) // Socket buffer, rides out bursts while the thread sleeps
+#define CC_LAST_SWITCH 69              // Controllers 64-69 are switches, from 120 on channel modes
+
+// Latest value of a controller or parameter not queued yet
+typedef struct Pending
+{
+    bool waiting;
+    SynthEvent event;
+} Pending;
+
+static EventFanout *osc_targets = NULL;
+static void (*osc_wake)(void) = NULL;
+static OscSocket osc_socket = NO_SOCKET;
+static bool osc_started = false; // Winsock is up
+static SDL_Thread *osc_thread = NULL;
+static SDL_atomic_t osc_running;
+static int osc_merged = 0;
+static int osc_dropped = 0;
+
+// Input thread
+static Uint64 flush_ticks; // One synth block in performance counter ticks
+static Uint64 flush_at;    // When the oldest merged value is due
+static Pending pending_controls[SYNTH_NOTES];
+static Pending pending_params[PARAM_COUNT];
+static int pending_count = 0;
+static char packets[OSC_BATCH][OSC_MAX_PACKET];
+static int packet_sizes[OSC_BATCH];
+
+static void push_event(const SynthEvent *event)
+{
+    if (osc_wake)
+        osc_wake();
+    if (!event_fanout_push(osc_targets, event))
+        osc_dropped++;
+}
+
+// Everything merged so far onto the queue
+static void flush_pending(void)
+{
+    if (pending_count == 0)
+        return;
+
+    for (int c = 0; c < SYNTH_NOTES; c++)
+        if (pending_controls[c].waiting)
+        {
+            push_event(&pending_controls[c].event);
+            pending_controls[c].waiting = false;
+        }
+    for (int p = 0; p < PARAM_COUNT; p++)
+        if (pending_params[p].waiting)
+        {
+            push_event(&pending_params[p].event);
+            pending_params[p].waiting = false;
+        }
+    pending_count = 0;
+}
+
+// Continuous controllers and parameters only matter for their latest value
+// and wait up to a block for the next one. Notes, switches and channel mode
+// messages go straight on, after whatever came before them.
+static void queue_event(const SynthEvent *event)
+{
+    Pending *slot = NULL;
+
+    if (event->type == EVENT_PARAM)
+        slot = &pending_params[event->note];
+    else if (event->type == EVENT_CONTROL &&
+             (event->note < CC_SUSTAIN || (event->note > CC_LAST_SWITCH && event->note < CC_ALL_SOUND_OFF)))
+        slot = &pending_controls[event->note];
+
+    if (!slot)
+    {
+        flush_pending();
+        push_event(event);
+        return;
+    }
+
+    if (slot->waiting)
+        osc_merged++;
+    else
+    {
+        if (pending_count++ == 0)
+            flush_at = event->time + flush_ticks;
+        slot->waiting = true;
+    }
+    slot->event = *event;
+}
+
+static Uint32 read_u32(const char *at)
+{
+    Uint32 value;
+    SDL_memcpy(&value, at, 4);
+    return SDL_SwapBE32(value);
+}
+
+// OSC strings end in a zero and are padded to four bytes, NULL when one
+// runs past the end of the packet
+static const char *read_string(const char **at, const char *end)
+{
+    const char *s = *at;
+    const char *zero = memchr(s, '\0', end - s);
+
+    if (!zero)
+        return NULL;
+    *at = s + ((zero - s) / 4 + 1) * 4;
+    return *at <= end ? s : NULL;
+}
+
+static Uint8 midi_value(float value)
+{
+    return (Uint8)SDL_clamp((int)value, 0, 127);
+}
+
+static void decode_message(const char *data, int size, Uint64 time)
+{
+    const char *at = data, *end = data + size;
+    const char *address = read_string(&at, end);
+    const char *tags = address ? read_string(&at, end) : NULL;
+    float args[2];
+    int count = 0;
+
+    if (!tags || tags[0] != ',')
+        return;
+
+    // The first two numbers, anything else ends the arguments
+    for (const char *t = tags + 1; *t && count < 2 && end - at >= 4; t++, at += 4)
+    {
+        Uint32 bits = read_u32(at);
+        if (*t == 'i')
+            args[count++] = (float)(Sint32)bits;
+        else if (*t == 'f')
+            SDL_memcpy(&args[count++], &bits, 4);
+        else
+            break;
+    }
+
+    SynthEvent event;
+    SDL_zero(event);
+    event.time = time;
+    int param;
+    if (SDL_strcmp(address, "/note/on") == 0 && count >= 1)
+    {
+        event.type = EVENT_NOTE_ON;
+        event.note = midi_value(args[0]);
+        event.value = count > 1 ? midi_value(args[1]) : 127;
+    }
+    else if (SDL_strcmp(address, "/note/off") == 0 && count >= 1)
+    {
+        event.type = EVENT_NOTE_OFF;
+        event.note = midi_value(args[0]);
+    }
+    else if (SDL_strcmp(address, "/cc") == 0 && count >= 2)
+    {
+        event.type = EVENT_CONTROL;
+        event.note = midi_value(args[0]);
+        event.value = midi_value(args[1]);
+    }
+    else if (SDL_strncmp(address, "/param/", 7) == 0 && count >= 1 && (param = synth_find_param(address + 7)) >= 0)
+    {
+        event.type = EVENT_PARAM;
+        event.note = (Uint8)param;
+        event.amount = args[0];
+    }
+    else
+        return;
+    queue_event(&event);
+}
+
+static void decode_packet(const char *data, int size, Uint64 time, int depth)
+{
+    if (size >= 16 && SDL_memcmp(data, "#bundle", 8) == 0)
+    {
+        if (depth == OSC_MAX_DEPTH)
+            return;
+
+        // Past the time tag, each element is its size and a packet
+        const char *end = data + size;
+        for (const char *at = data + 16; end - at >= 4;)
+        {
+            Uint32 length = read_u32(at);
+            at += 4;
+            if (length > (Uint32)(end - at))
+                return;
+            decode_packet(at, (int)length, time, depth + 1);
+            at += length;
+        }
+    }
+    else if (size > 0 && data[0] == '/')
+        decode_message(data, size, time);
+}
+
+// Up to OSC_BATCH datagrams that are waiting already, without blocking
+static int receive_batch(void)
+{
+#if defined(__linux__)
+    struct mmsghdr messages[OSC_BATCH];
+    struct iovec vectors[OSC_BATCH];
+
+    SDL_memset(messages, 0, sizeof(messages));
+    for (int i = 0; i < OSC_BATCH; i++)
+    {
+        vectors[i].iov_base = packets[i];
+        vectors[i].iov_len = OSC_MAX_PACKET;
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // One system call for the whole burst
+    int count = recvmmsg(osc_socket, messages, OSC_BATCH, MSG_DONTWAIT, NULL);
+    for (int i = 0; i < count; i++)
+        packet_sizes[i] = (int)messages[i].msg_len;
+    return SDL_max(count, 0);
+#else
+    int count = 0;
+    while (count < OSC_BATCH)
+    {
+        int size = (int)recv(osc_socket, packets[count], OSC_MAX_PACKET, 0);
+        if (size < 0)
+            break; // Nothing left, or a stray ICMP error on Windows
+        packet_sizes[count++] = size;
+    }
+    return count;
+#endif
+}
+
+static int osc_thread_main(void *data)
+{
+    (void)data;
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+
+    while (SDL_AtomicGet(&osc_running))
+    {
+        // Sleep until a datagram comes in or the merged values are due
+        Uint64 now = SDL_GetPerformanceCounter();
+        Uint64 wait_us = OSC_POLL_MS * 1000;
+        if (pending_count > 0)
+            wait_us = flush_at > now ? (flush_at - now) * 1000000 / SDL_GetPerformanceFrequency() : 0;
+
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(osc_socket, &readable);
+        struct timeval timeout = {(long)(wait_us / 1000000), (long)(wait_us % 1000000)};
+        if (select((int)osc_socket + 1, &readable, NULL, NULL, &timeout) > 0)
+        {
+            int count;
+            do
+            {
+                count = receive_batch();
+
+                // Stamp the whole batch at wakeup, before decoding costs anything
+                Uint64 time = SDL_GetPerformanceCounter();
+                for (int i = 0; i < count; i++)
+                    decode_packet(packets[i], packet_sizes[i], time, 0);
+                if (pending_count > 0 && time >= flush_at)
+                    flush_pending();
+            } while (count == OSC_BATCH);
+        }
+
+        if (pending_count > 0 && SDL_GetPerformanceCounter() >= flush_at)
+            flush_pending();
+    }
+    return 0;
+}
+
+bool osc_input_open(EventFanout *targets, int port, int sample_rate, void (*wake)(void))
+{
+#if defined(_WIN32)
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+    {
+        SDL_Log("OSC: cannot start Winsock");
+        return false;
+    }
+    osc_started = true;
+#endif
+
+    struct sockaddr_in address;
+    SDL_zero(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons((unsigned short)port);
+
+    osc_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    bool ok = osc_socket != NO_SOCKET;
+    if (ok)
+    {
+        int size = OSC_RECEIVE_BUFFER;
+        setsockopt(osc_socket, SOL_SOCKET, SO_RCVBUF, (const char *)&size, sizeof(size));
+#if defined(_WIN32)
+        u_long nonblocking = 1;
+        ok = ioctlsocket(osc_socket, FIONBIO, &nonblocking) == 0;
+#else
+        ok = fcntl(osc_socket, F_SETFL, fcntl(osc_socket, F_GETFL, 0) | O_NONBLOCK) != -1;
+#endif
+    }
+    if (!ok || bind(osc_socket, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        SDL_Log("OSC: cannot listen on UDP port %d", port);
+        osc_input_close();
+        return false;
+    }
+
+    osc_targets = targets;
+    osc_wake = wake;
+    flush_ticks = (Uint64)((double)SYNTH_BLOCK_SIZE / sample_rate * SDL_GetPerformanceFrequency());
+    SDL_AtomicSet(&osc_running, 1);
+    osc_thread = SDL_CreateThread(osc_thread_main, "osc input", NULL);
+    if (!osc_thread)
+    {
+        SDL_Log("OSC: cannot create input thread: %s", SDL_GetError());
+        osc_input_close();
+        return false;
+    }
+
+    SDL_Log("OSC: listening on UDP port %d", port);
+    return true;
+}
+
+void osc_input_close(void)
+{
+    if (osc_thread)
+    {
+        SDL_AtomicSet(&osc_running, 0);
+        SDL_WaitThread(osc_thread, NULL);
+        osc_thread = NULL;
+    }
+    if (osc_socket != NO_SOCKET)
+    {
+        close_socket(osc_socket);
+        osc_socket = NO_SOCKET;
+    }
+#if defined(_WIN32)
+    if (osc_started)
+        WSACleanup();
+#endif
+    osc_started = false;
+
+    if (osc_merged)
+        SDL_Log("OSC: %d controller messages merged into later ones", osc_merged);
+    if (osc_dropped)
+        SDL_Log("OSC: %d events dropped, event queue full", osc_dropped);
+    osc_merged = 0;
+    osc_dropped = 0;
+}
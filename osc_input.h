@@ -0,0 +1,29 @@
+#ifndef OSC_INPUT_H
+#define OSC_INPUT_H
+
+#include <stdbool.h>
+
+#include "event_queue.h"
+
+#define OSC_PORT 9000 // Default UDP port
+
+// Open Sound Control over UDP on its own thread, listening on `port` of
+// every interface. Messages are stamped as they arrive and pushed into
+// every queue of `targets`; bundle time tags are not honoured, bundles play
+// on arrival.
+//
+//   /note/on NOTE [VELOCITY]   velocity 127 when left out, 0 is a note off
+//   /note/off NOTE
+//   /cc CONTROLLER VALUE       MIDI control change, 0-127
+//   /param/NAME VALUE          patch parameter such as /param/cutoff 800
+//
+// Arguments may be int32 or float32. Controller streams are thinned out
+// before they reach the queue: repeated values of a continuous controller
+// or parameter within one synth block of `sample_rate` are merged into the
+// latest, and whatever is pending goes out before the next note so the
+// order of notes and controllers holds. `wake` is called from the input
+// thread before events are queued.
+bool osc_input_open(EventFanout *targets, int port, int sample_rate, void (*wake)(void));
+void osc_input_close(void);
+
+#endif
@@ -0,0 +1,142 @@
+// stat() is outside strict ISO C modes
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "patch.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// `text` without the blanks around it, in place
+static char *trim(char *text)
+{
+    while (*text == ' ' || *text == '\t')
+        text++;
+    char *end = text + SDL_strlen(text);
+    while (end > text && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+        *--end = '\0';
+    return text;
+}
+
+static bool parse_line(Patch *patch, char *line)
+{
+    char *equals = SDL_strchr(line, '=');
+    if (!equals)
+        return false;
+    *equals = '\0';
+    char *name = trim(line);
+    char *value = equals + 1;
+
+    // The graph has its own comments and '=', its statements go over as they are
+    if (SDL_strcmp(name, "graph") == 0)
+    {
+        size_t length = SDL_strlen(patch->graph);
+        value = trim(value);
+        if (length + SDL_strlen(value) + 2 > sizeof(patch->graph))
+            return false;
+        SDL_snprintf(patch->graph + length, sizeof(patch->graph) - length, "%s\n", value);
+        return true;
+    }
+
+    char *comment = SDL_strchr(value, '#');
+    if (comment)
+        *comment = '\0';
+    value = trim(value);
+    int param = synth_find_param(name);
+    char *end;
+    double number = SDL_strtod(value, &end);
+    if (param < 0 || end == value || *end != '\0')
+        return false;
+    patch->values[param] = (float)number;
+    patch->set |= 1u << param;
+    return true;
+}
+
+// Whole file into `text`, false when it cannot be read or is too long
+static bool read_text(const char *path, char *text, size_t size)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        SDL_Log("Cannot open patch %s", path);
+        return false;
+    }
+    size_t length = fread(text, 1, size - 1, file);
+    bool complete = feof(file) && !ferror(file);
+    fclose(file);
+    if (!complete)
+    {
+        SDL_Log("Cannot read patch %s, the limit is %d bytes", path, (int)size - 1);
+        return false;
+    }
+    text[length] = '\0';
+    return true;
+}
+
+static bool parse_text(Patch *patch, const char *path, char *text)
+{
+    int line_number = 0;
+
+    SDL_zerop(patch);
+    for (char *line = text; line;)
+    {
+        char *next = SDL_strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        line_number++;
+
+        char *start = trim(line);
+        if (*start != '\0' && *start != '#' && !parse_line(patch, start))
+        {
+            SDL_Log("%s:%d: bad patch line", path, line_number);
+            return false;
+        }
+        line = next;
+    }
+    return true;
+}
+
+void patch_watch_init(PatchWatch *watch, const char *path)
+{
+    SDL_zerop(watch);
+    watch->path = path;
+    watch->mtime = -1;
+    watch->size = -1;
+}
+
+bool patch_poll(PatchWatch *watch, Patch *patch)
+{
+    static char text[PATCH_MAX_BYTES]; // Main thread only
+    struct stat st;
+
+    // Gone for a moment while an editor replaces it, look again next time
+    if (stat(watch->path, &st) != 0)
+    {
+        if (watch->mtime < 0)
+            SDL_Log("Cannot open patch %s", watch->path);
+        return false;
+    }
+
+    // The time has whole seconds, a file written within the last one is
+    // read again in case it changed since
+    bool recent = (Sint64)time(NULL) - (Sint64)st.st_mtime < 2;
+    if (!recent && (Sint64)st.st_mtime == watch->mtime && (Sint64)st.st_size == watch->size)
+        return false;
+    watch->mtime = (Sint64)st.st_mtime;
+    watch->size = (Sint64)st.st_size;
+    if (!read_text(watch->path, text, sizeof(text)))
+        return false;
+
+    Uint32 hash = 2166136261u; // FNV-1a
+    for (const char *c = text; *c; c++)
+        hash = (hash ^ (Uint8)*c) * 16777619u;
+    if (watch->loaded && hash == watch->hash)
+        return false;
+    watch->hash = hash;
+    watch->loaded = true;
+
+    // A file that does not parse is skipped until it is written again
+    return parse_text(patch, watch->path, text);
+}
@@ -0,0 +1,42 @@
+#ifndef PATCH_H
+#define PATCH_H
+
+#include <SDL.h>
+#include <stdbool.h>
+
+#include "synth.h"
+
+#define PATCH_MAX_BYTES 16384
+#define PATCH_GRAPH_LENGTH 4096
+
+// Sound settings from a patch file, one "NAME = VALUE" per line. NAME is
+// level, attack, decay, sustain, release, cutoff, resonance, filter_env or
+// spread, see the PARAM_ values, or graph with one graph statement as the
+// value, any number of times, see graph_parse(). '#' starts a comment.
+typedef struct Patch
+{
+    float values[PARAM_COUNT];
+    Uint32 set;                     // Bit per parameter the file gives, the others are left as they are
+    char graph[PATCH_GRAPH_LENGTH]; // Graph statements, one per line, empty for the voices alone
+} Patch;
+
+// What was last seen of a watched patch file
+typedef struct PatchWatch
+{
+    const char *path;
+    Sint64 mtime;
+    Sint64 size;
+    Uint32 hash; // Of the contents last read
+    bool loaded;
+} PatchWatch;
+
+void patch_watch_init(PatchWatch *watch, const char *path);
+
+// Main thread: read the file again when it was written since the last call
+// and its contents differ, the first call always reads it. True when
+// `patch` now holds the new settings, false when nothing changed or the
+// file cannot be read or parsed, with the reason logged. Cheap enough to
+// poll from the main loop.
+bool patch_poll(PatchWatch *watch, Patch *patch);
+
+#endif
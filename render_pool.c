@@ -0,0 +1,167 @@
+#include "render_pool.h"
+
+#include "audio_memory.h"
+
+#define RANGE(next, end) ((int)((next) << 16 | (end)))
+
+// Render one group of voices into its partial buffer
+static void render_group(RenderPool *pool, int group)
+{
+    Synth *synth = pool->synth;
+    float *partial = pool->partial[group];
+    int first = group * RENDER_GROUP_VOICES;
+    int last = SDL_min(first + RENDER_GROUP_VOICES, synth->active_count);
+
+    for (int c = 0; c < synth->channels; c++)
+        SDL_memset(partial + c * SYNTH_BLOCK_SIZE, 0, pool->frames * sizeof(float));
+    synth_render_voices(synth, first, last, partial, pool->scratch[group], pool->frames);
+}
+
+// Take the next job of a range, -1 once it is empty
+static int claim(RenderRange *range)
+{
+    for (;;)
+    {
+        int value = SDL_AtomicGet(&range->range);
+        int next = value >> 16, end = value & 0xFFFF;
+        if (next >= end)
+            return -1;
+        if (SDL_AtomicCAS(&range->range, value, RANGE(next + 1, end)))
+            return next;
+    }
+}
+
+// Drain our own range first, then steal from the other participants
+static void run_jobs(RenderPool *pool, int self)
+{
+    int participants = pool->worker_count + 1;
+
+    for (int i = 0; i < participants; i++)
+    {
+        RenderRange *range = &pool->ranges[(self + i) % participants];
+        int group;
+        while ((group = claim(range)) >= 0)
+        {
+            // The block parameters were published before the range
+            SDL_MemoryBarrierAcquire();
+            render_group(pool, group);
+            SDL_MemoryBarrierRelease();
+            SDL_AtomicIncRef(&pool->done);
+        }
+    }
+}
+
+static int worker_main(void *data)
+{
+    RenderWorker *worker = data;
+    RenderPool *pool = worker->pool;
+
+    // Raising the priority may allocate, only trap allocations after it
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+    audio_memory_enter_rt();
+
+    // A stale wake-up finds every range empty and goes back to sleep
+    while (SDL_SemWait(worker->wake) == 0 && SDL_AtomicGet(&pool->running))
+        run_jobs(pool, worker->index);
+
+    audio_memory_leave_rt();
+    return 0;
+}
+
+bool render_pool_start(RenderPool *pool, int workers, int sample_rate)
+{
+    SDL_zerop(pool);
+    pool->deadline_per_frame = RENDER_DEADLINE * SDL_GetPerformanceFrequency() / sample_rate;
+    SDL_AtomicSet(&pool->running, 1);
+
+    for (int i = 0; i < SDL_min(workers, RENDER_POOL_MAX_WORKERS); i++)
+    {
+        RenderWorker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i + 1;
+        worker->wake = SDL_CreateSemaphore(0);
+        if (worker->wake)
+            worker->thread = SDL_CreateThread(worker_main, "synth worker", worker);
+        if (!worker->thread)
+        {
+            SDL_Log("Error creating render worker: %s", SDL_GetError());
+            if (worker->wake)
+                SDL_DestroySemaphore(worker->wake);
+            render_pool_stop(pool);
+            return false;
+        }
+        pool->worker_count++;
+    }
+    return true;
+}
+
+void render_pool_stop(RenderPool *pool)
+{
+    SDL_AtomicSet(&pool->running, 0);
+    for (int i = 0; i < pool->worker_count; i++)
+        SDL_SemPost(pool->workers[i].wake);
+    for (int i = 0; i < pool->worker_count; i++)
+    {
+        SDL_WaitThread(pool->workers[i].thread, NULL);
+        SDL_DestroySemaphore(pool->workers[i].wake);
+    }
+    pool->worker_count = 0;
+}
+
+bool render_pool_usable(RenderPool *pool)
+{
+    if (!pool || pool->worker_count == 0)
+        return false;
+    if (pool->backoff > 0)
+    {
+        pool->backoff--;
+        return false;
+    }
+    return true;
+}
+
+void render_pool_render(RenderPool *pool, Synth *synth, float *mix, int frames)
+{
+    int groups = (synth->active_count + RENDER_GROUP_VOICES - 1) / RENDER_GROUP_VOICES;
+    int participants = SDL_min(pool->worker_count + 1, groups);
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint64 deadline = start + (Uint64)(frames * pool->deadline_per_frame);
+
+    // Publish the block, then hand out contiguous ranges of groups. Ranges of
+    // workers beyond `participants` stay empty from the previous block.
+    pool->synth = synth;
+    pool->frames = frames;
+    pool->group_count = groups;
+    SDL_AtomicSet(&pool->done, 0);
+    SDL_MemoryBarrierRelease();
+    for (int p = 0; p < participants; p++)
+        SDL_AtomicSet(&pool->ranges[p].range, RANGE(p * groups / participants, (p + 1) * groups / participants));
+    for (int p = participants; p <= pool->worker_count; p++)
+        SDL_AtomicSet(&pool->ranges[p].range, 0);
+    for (int i = 0; i < participants - 1; i++)
+        SDL_SemPost(pool->workers[i].wake);
+
+    // Work alongside the pool, then wait for the jobs others still hold
+    run_jobs(pool, 0);
+    bool missed = false;
+    while (SDL_AtomicGet(&pool->done) < groups)
+        missed = missed || SDL_GetPerformanceCounter() > deadline;
+    SDL_MemoryBarrierAcquire();
+    if (missed)
+    {
+        SDL_AtomicIncRef(&pool->misses);
+        pool->backoff = RENDER_BACKOFF_BLOCKS;
+    }
+
+    // Fixed summation order keeps the mix independent of the schedule
+    for (int g = 0; g < groups; g++)
+    {
+        for (int c = 0; c < synth->channels; c++)
+        {
+            const float *partial = pool->partial[g] + c * SYNTH_BLOCK_SIZE;
+            float *bus = mix + c * SYNTH_BLOCK_SIZE;
+            for (int i = 0; i < frames; i++)
+                bus[i] += partial[i];
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef RENDER_POOL_H
+#define RENDER_POOL_H
+
+#include <SDL.h>
+#include <stdbool.h>
+
+#include "synth.h"
+
+#define RENDER_POOL_MAX_WORKERS 7 // Helper threads, the audio thread takes part too
+#define RENDER_GROUP_VOICES 8     // Voices per job, also the least worth splitting
+#define RENDER_MAX_GROUPS (SYNTH_MAX_VOICES / RENDER_GROUP_VOICES)
+#define RENDER_DEADLINE 0.5 // Join budget as a fraction of the block's duration
+#define RENDER_BACKOFF_BLOCKS 256 // Blocks rendered without the workers after a missed deadline
+
+// Claimable job range of one participant, packed as next << 16 | end so a
+// single CAS takes a job. Padded so owners don't share cache lines.
+typedef struct RenderRange
+{
+    SDL_atomic_t range;
+    char padding[64 - sizeof(SDL_atomic_t)];
+} RenderRange;
+
+struct RenderPool;
+
+typedef struct RenderWorker
+{
+    SDL_Thread *thread;
+    SDL_sem *wake; // Posted once per block
+    struct RenderPool *pool;
+    int index;     // Participant index, the audio thread is 0
+} RenderWorker;
+
+// Fixed pool of pre-spawned worker threads that render the voices of one
+// block in parallel. The active voices are cut into groups of
+// RENDER_GROUP_VOICES, each group mixes into its own partial buffer and the
+// partials are summed in group order, so the result does not depend on
+// which thread ran which job. Every participant starts on its own range of
+// groups and steals from the others' ranges once its own is empty.
+//
+// The audio thread only publishes the block, wakes the workers and joins
+// on an atomic counter, rendering jobs itself while it waits. A job a
+// worker has claimed is never taken back, the voices it renders carry
+// their phase and envelope on; if the join runs past the deadline,
+// synth_render() renders on the audio thread alone for the next
+// RENDER_BACKOFF_BLOCKS blocks and then tries the pool again.
+typedef struct RenderPool
+{
+    RenderWorker workers[RENDER_POOL_MAX_WORKERS];
+    int worker_count;
+    SDL_atomic_t running;
+    SDL_atomic_t misses;    // Deadlines missed, counted by the audio thread
+    int backoff;            // Audio thread: blocks left to render without the workers
+    SDL_atomic_t done;      // Jobs finished in the current block
+    double deadline_per_frame; // Longest join allowed per frame of block, in ticks
+
+    // Current block, written by the audio thread before the ranges are reset
+    Synth *synth;
+    int frames;
+    int group_count;
+
+    RenderRange ranges[RENDER_POOL_MAX_WORKERS + 1]; // Index 0 is the audio thread
+    float partial[RENDER_MAX_GROUPS][SYNTH_MAX_CHANNELS * SYNTH_BLOCK_SIZE]; // Planar like the synth bus
+    float scratch[RENDER_MAX_GROUPS][SYNTH_FILTER_LANES * SYNTH_BLOCK_SIZE];
+} RenderPool;
+
+// Spawn `workers` real-time threads, false if any fails to start
+bool render_pool_start(RenderPool *pool, int workers, int sample_rate);
+void render_pool_stop(RenderPool *pool);
+
+// Audio thread: render every active voice of `synth` for one block and add
+// the result to the planar bus `mix`. The envelopes must already be updated for the block.
+void render_pool_render(RenderPool *pool, Synth *synth, float *mix, int frames);
+
+// Audio thread, once per block: false without workers and for the blocks
+// after a missed deadline, which it counts down
+bool render_pool_usable(RenderPool *pool);
+
+#endif
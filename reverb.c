@@ -0,0 +1,337 @@
+#include "reverb.h"
+
+#include <stdio.h>
+
+#include "wav.h"
+
+#define IR_MAX_CHANNELS 2
+
+// Loaded impulse responses with a reference left, each build thread and
+// the UI thread look them up. Held only to walk or relink the list.
+static SDL_SpinLock cache_lock;
+static ReverbIr *cache = NULL;
+
+static void free_ir(ReverbIr *ir)
+{
+    if (ir)
+    {
+        SDL_free(ir->re);
+        SDL_free(ir->im);
+        SDL_free(ir->path);
+        SDL_free(ir);
+    }
+}
+
+// A reference to the cached IR for `path` at `sample_rate`, if any; with
+// the lock taken
+static ReverbIr *find_ir(const char *path, int sample_rate)
+{
+    for (ReverbIr *ir = cache; ir; ir = ir->next)
+        if (ir->sample_rate == sample_rate && SDL_strcmp(ir->path, path) == 0)
+        {
+            ir->refs++;
+            return ir;
+        }
+    return NULL;
+}
+
+void reverb_ir_release(ReverbIr *ir)
+{
+    if (!ir)
+        return;
+
+    SDL_AtomicLock(&cache_lock);
+    bool last = --ir->refs == 0;
+    if (last)
+    {
+        ReverbIr **link = &cache;
+        while (*link != ir)
+            link = &(*link)->next;
+        *link = ir->next;
+    }
+    SDL_AtomicUnlock(&cache_lock);
+
+    if (last)
+        free_ir(ir);
+}
+
+// Whole file as float frames of at most IR_MAX_CHANNELS, cut at
+// REVERB_MAX_SECONDS
+static float *read_ir(const char *path, WavInfo *info, int *channels, Uint32 *frames)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file || !wav_read_info(file, info) || info->frames == 0 || fseek(file, info->data_offset, SEEK_SET) != 0)
+    {
+        if (file)
+            fclose(file);
+        return NULL;
+    }
+
+    *channels = SDL_min(info->channels, IR_MAX_CHANNELS);
+    *frames = (Uint32)SDL_min((double)info->frames, REVERB_MAX_SECONDS * info->sample_rate);
+    size_t frame_bytes = (size_t)info->bytes_per_sample * info->channels;
+    Uint8 *raw = SDL_malloc(*frames * frame_bytes);
+    float *samples = SDL_malloc(*frames * *channels * sizeof(float));
+    if (!raw || !samples || fread(raw, frame_bytes, *frames, file) != *frames)
+    {
+        SDL_free(raw);
+        SDL_free(samples);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    for (Uint32 f = 0; f < *frames; f++)
+    {
+        const Uint8 *frame = raw + f * frame_bytes;
+        for (int c = 0; c < *channels; c++)
+        {
+            float value;
+            if (info->is_float)
+            {
+                float sample;
+                SDL_memcpy(&sample, frame + c * 4, 4);
+                value = SDL_SwapFloatLE(sample);
+            }
+            else
+            {
+                Sint16 sample;
+                SDL_memcpy(&sample, frame + c * 2, 2);
+                value = (Sint16)SDL_SwapLE16(sample) * (1.0f / 32768.0f);
+            }
+            samples[f * *channels + c] = value;
+        }
+    }
+    SDL_free(raw);
+    return samples;
+}
+
+static ReverbIr *load_ir(const char *path, int sample_rate)
+{
+    WavInfo info;
+    int channels;
+    Uint32 frames;
+    float *samples = read_ir(path, &info, &channels, &frames);
+    if (!samples)
+    {
+        SDL_Log("Cannot load impulse response %s, expected 16-bit or float WAV", path);
+        return NULL;
+    }
+
+    // Linear resampling is plenty for a reverb tail
+    double step = (double)info.sample_rate / sample_rate;
+    Uint32 length = (Uint32)(frames / step);
+    int partitions = SDL_max((int)((length + REVERB_PARTITION - 1) / REVERB_PARTITION), 1);
+
+    ReverbIr *ir = SDL_calloc(1, sizeof(ReverbIr));
+    size_t bins = (size_t)channels * partitions * REVERB_BINS;
+    Fft fft;
+    float *padded = SDL_malloc(2 * REVERB_PARTITION * sizeof(float));
+    bool transform = ir && padded && fft_init(&fft, 2 * REVERB_PARTITION);
+    bool ok = transform;
+    if (ok)
+    {
+        ir->partitions = partitions;
+        ir->channels = channels;
+        ir->sample_rate = sample_rate;
+        ir->refs = 1;
+        ir->path = SDL_strdup(path);
+        ir->re = SDL_malloc(bins * sizeof(float));
+        ir->im = SDL_malloc(bins * sizeof(float));
+        ok = ir->path && ir->re && ir->im;
+    }
+
+    for (int c = 0; ok && c < channels; c++)
+    {
+        for (int p = 0; p < partitions; p++)
+        {
+            SDL_memset(padded, 0, 2 * REVERB_PARTITION * sizeof(float));
+            for (int i = 0; i < REVERB_PARTITION; i++)
+            {
+                double position = ((double)p * REVERB_PARTITION + i) * step;
+                Uint32 index = (Uint32)position;
+                if (index >= frames)
+                    break;
+                float a = samples[index * channels + c];
+                if (index + 1 == frames)
+                {
+                    padded[i] = a; // The last sample has no partner to interpolate towards
+                    continue;
+                }
+                float fraction = (float)(position - index);
+                float b = samples[(index + 1) * channels + c];
+                padded[i] = a + (b - a) * fraction;
+            }
+
+            size_t at = ((size_t)c * partitions + p) * REVERB_BINS;
+            fft_real(&fft, padded, ir->re + at, ir->im + at);
+
+            // The inverse transform scales by its size, take it out once here
+            for (int k = 0; k < REVERB_BINS; k++)
+            {
+                ir->re[at + k] *= 1.0f / (2 * REVERB_PARTITION);
+                ir->im[at + k] *= 1.0f / (2 * REVERB_PARTITION);
+            }
+        }
+    }
+
+    if (transform)
+        fft_free(&fft);
+    SDL_free(padded);
+    SDL_free(samples);
+    if (!ok)
+    {
+        SDL_Log("Out of memory for impulse response %s", path);
+        free_ir(ir);
+        return NULL;
+    }
+    return ir;
+}
+
+ReverbIr *reverb_ir_load(const char *path, int sample_rate)
+{
+    SDL_AtomicLock(&cache_lock);
+    ReverbIr *ir = find_ir(path, sample_rate);
+    SDL_AtomicUnlock(&cache_lock);
+    if (ir)
+        return ir;
+
+    // Loaded without the lock, another build may have got there first
+    ReverbIr *loaded = load_ir(path, sample_rate);
+    if (!loaded)
+        return NULL;
+
+    SDL_AtomicLock(&cache_lock);
+    ir = find_ir(path, sample_rate);
+    if (!ir)
+    {
+        ir = loaded;
+        ir->next = cache;
+        cache = ir;
+    }
+    SDL_AtomicUnlock(&cache_lock);
+
+    if (ir != loaded)
+        free_ir(loaded);
+    return ir;
+}
+
+bool reverb_init(Reverb *reverb, ReverbIr *ir, int channels)
+{
+    SDL_zerop(reverb);
+    reverb->ir = ir;
+    reverb->channels = channels;
+
+    size_t bins = (size_t)channels * ir->partitions * REVERB_BINS;
+    reverb->line_re = SDL_calloc(bins, sizeof(float));
+    reverb->line_im = SDL_calloc(bins, sizeof(float));
+    if (!reverb->line_re || !reverb->line_im || !fft_init(&reverb->fft, 2 * REVERB_PARTITION))
+    {
+        reverb_free(reverb);
+        return false;
+    }
+    return true;
+}
+
+void reverb_free(Reverb *reverb)
+{
+    SDL_free(reverb->line_re);
+    SDL_free(reverb->line_im);
+    fft_free(&reverb->fft);
+    reverb_ir_release(reverb->ir);
+    SDL_zerop(reverb);
+}
+
+// `sum` += `x` * `h` over the bins, restrict so it vectorizes without
+// alias checks
+static void multiply_add(float *restrict sum_re, float *restrict sum_im, const float *restrict xr,
+                         const float *restrict xi, const float *restrict hr, const float *restrict hi)
+{
+    for (int k = 0; k < REVERB_BINS; k++)
+    {
+        sum_re[k] += xr[k] * hr[k] - xi[k] * hi[k];
+        sum_im[k] += xr[k] * hi[k] + xi[k] * hr[k];
+    }
+}
+
+// Sum the delay line against IR partitions up to `target` for the output
+// after the next transform, when the newest spectrum moves one slot back
+static void sum_older(Reverb *reverb, int target)
+{
+    const ReverbIr *ir = reverb->ir;
+    int partitions = ir->partitions;
+
+    for (int c = 0; c < reverb->channels; c++)
+    {
+        const float *line_re = reverb->line_re + (size_t)c * partitions * REVERB_BINS;
+        const float *line_im = reverb->line_im + (size_t)c * partitions * REVERB_BINS;
+        const float *ir_re = ir->re + (size_t)(c % ir->channels) * partitions * REVERB_BINS;
+        const float *ir_im = ir->im + (size_t)(c % ir->channels) * partitions * REVERB_BINS;
+        for (int p = reverb->summed + 1; p <= target; p++)
+        {
+            int slot = reverb->position + 1 - p;
+            if (slot < 0)
+                slot += partitions;
+            multiply_add(reverb->sum_re[c], reverb->sum_im[c], line_re + slot * REVERB_BINS,
+                         line_im + slot * REVERB_BINS, ir_re + p * REVERB_BINS, ir_im + p * REVERB_BINS);
+        }
+    }
+    reverb->summed = SDL_max(reverb->summed, target);
+}
+
+// A full partition of input is in: finish the older products, transform the
+// input into the delay line and add it against the first IR partition
+static void run_partition(Reverb *reverb)
+{
+    const ReverbIr *ir = reverb->ir;
+    int partitions = ir->partitions;
+
+    sum_older(reverb, partitions - 1);
+    reverb->position = reverb->position + 1 < partitions ? reverb->position + 1 : 0;
+    for (int c = 0; c < reverb->channels; c++)
+    {
+        float *line_re = reverb->line_re + ((size_t)c * partitions + reverb->position) * REVERB_BINS;
+        float *line_im = reverb->line_im + ((size_t)c * partitions + reverb->position) * REVERB_BINS;
+        const float *ir_re = ir->re + (size_t)(c % ir->channels) * partitions * REVERB_BINS;
+        const float *ir_im = ir->im + (size_t)(c % ir->channels) * partitions * REVERB_BINS;
+        float *sum_re = reverb->sum_re[c];
+        float *sum_im = reverb->sum_im[c];
+
+        fft_real(&reverb->fft, reverb->input[c], line_re, line_im);
+        multiply_add(sum_re, sum_im, line_re, line_im, ir_re, ir_im);
+
+        // Overlap-save: the second half is the linear convolution
+        fft_real_inverse(&reverb->fft, sum_re, sum_im, reverb->time);
+        SDL_memcpy(reverb->output[c], reverb->time + REVERB_PARTITION, REVERB_PARTITION * sizeof(float));
+        SDL_memcpy(reverb->input[c], reverb->input[c] + REVERB_PARTITION, REVERB_PARTITION * sizeof(float));
+        SDL_memset(sum_re, 0, sizeof(reverb->sum_re[c]));
+        SDL_memset(sum_im, 0, sizeof(reverb->sum_im[c]));
+    }
+    reverb->summed = 0;
+}
+
+void reverb_process(Reverb *reverb, float *out, const float *in, int stride, int frames)
+{
+    for (int i = 0; i < frames;)
+    {
+        int run = SDL_min(frames - i, REVERB_PARTITION - reverb->fill);
+        size_t bytes = run * sizeof(float);
+
+        // Input taken before the output goes out, so in place works
+        for (int c = 0; c < reverb->channels; c++)
+        {
+            SDL_memcpy(reverb->input[c] + REVERB_PARTITION + reverb->fill, in + c * stride + i, bytes);
+            SDL_memcpy(out + c * stride + i, reverb->output[c] + reverb->fill, bytes);
+        }
+
+        reverb->fill += run;
+        i += run;
+        if (reverb->fill == REVERB_PARTITION)
+        {
+            run_partition(reverb);
+            reverb->fill = 0;
+        }
+        else
+            sum_older(reverb, (reverb->ir->partitions - 1) * reverb->fill / REVERB_PARTITION);
+    }
+}
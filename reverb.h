@@ -0,0 +1,71 @@
+#ifndef REVERB_H
+#define REVERB_H
+
+#include <SDL.h>
+#include <stdbool.h>
+
+#include "fft.h"
+#include "synth_kernels.h"
+
+#define REVERB_PARTITION 256 // Frames per IR partition, also the latency of the wet signal
+#define REVERB_BINS (REVERB_PARTITION + 1)
+#define REVERB_MAX_SECONDS 10.0 // Longer impulse responses are cut
+
+// Impulse response cut into partitions of REVERB_PARTITION frames, each
+// zero padded to twice that and transformed once when it is loaded. Shared
+// by every reverb on the same file at the same rate, read only once loaded.
+typedef struct ReverbIr
+{
+    int partitions;
+    int channels; // 1 or 2, channel c of the output uses IR channel c % channels
+    float *re;    // Partition p of IR channel c at (c * partitions + p) * REVERB_BINS
+    float *im;
+    char *path;   // Cache key with the rate
+    int sample_rate;
+    int refs;
+    struct ReverbIr *next;
+} ReverbIr;
+
+// Uniformly partitioned overlap-save convolution. Each partition of input
+// is transformed once into a frequency domain delay line, and every
+// partition of output is the delay line times the IR spectra, summed, and
+// transformed back. Only the newest spectrum is needed once a partition
+// is in: the products with the older ones are summed a share at a time
+// while it fills, so blocks shorter than a partition each take their part
+// of the work and the last one adds a transform pair and one product.
+typedef struct Reverb
+{
+    ReverbIr *ir; // One reference, released by reverb_free()
+    Fft fft;      // 2 * REVERB_PARTITION points
+    int channels;
+    int fill;     // Frames of the current partition taken so far
+    int position; // Slot of the newest spectrum in the delay line
+    float *line_re; // Channel c, slot s at (c * partitions + s) * REVERB_BINS
+    float *line_im;
+    float input[SYNTH_MAX_CHANNELS][2 * REVERB_PARTITION]; // Previous and current partition
+    float output[SYNTH_MAX_CHANNELS][REVERB_PARTITION];    // Wet partition being played out
+    int summed; // IR partitions after the first already in the sums for the next output
+    float sum_re[SYNTH_MAX_CHANNELS][REVERB_BINS];
+    float sum_im[SYNTH_MAX_CHANNELS][REVERB_BINS];
+    float time[2 * REVERB_PARTITION];
+} Reverb;
+
+// Read a 16-bit or float WAV impulse response, resample it to
+// `sample_rate` and transform its partitions. Slow for long files, meant
+// for a background thread. An IR still in use for the same path and rate
+// is shared instead of loaded again. NULL with the reason logged on failure.
+ReverbIr *reverb_ir_load(const char *path, int sample_rate);
+
+// Drop a reference, the last one frees the IR
+void reverb_ir_release(ReverbIr *ir);
+
+// Take over the reference to `ir` and allocate the delay line for
+// `channels` channels
+bool reverb_init(Reverb *reverb, ReverbIr *ir, int channels);
+void reverb_free(Reverb *reverb);
+
+// Audio thread: `frames` of the planar input `in` through the reverb into
+// `out`, the wet signal only. `in` may be `out`.
+void reverb_process(Reverb *reverb, float *out, const float *in, int stride, int frames);
+
+#endif
@@ -0,0 +1,413 @@
+// mmap extras such as madvise() are outside strict ISO C modes
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "sampler.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "wav.h"
+
+#define RING_MASK (SAMPLER_RING_FRAMES - 1)
+
+void sampler_init(Sampler *sampler)
+{
+    SDL_zerop(sampler);
+}
+
+#if defined(_WIN32)
+
+static bool map_file(SampleData *sample, const char *path)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    // The mapping keeps its own reference to the file
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return false;
+    sample->map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!sample->map)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    sample->map_handle = mapping;
+    sample->map_size = (size_t)size.QuadPart;
+    VirtualLock(sample->map, sample->map_size); // Best effort, the prefault below is what counts
+    return true;
+}
+
+static void unmap_file(SampleData *sample)
+{
+    UnmapViewOfFile(sample->map);
+    CloseHandle(sample->map_handle);
+}
+
+#else
+
+static bool map_file(SampleData *sample, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+
+    if (fd < 0)
+        return false;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return false;
+
+    sample->map = map;
+    sample->map_size = (size_t)st.st_size;
+    madvise(map, sample->map_size, MADV_WILLNEED);
+    mlock(map, sample->map_size); // Best effort, often limited by RLIMIT_MEMLOCK
+    return true;
+}
+
+static void unmap_file(SampleData *sample)
+{
+    munlock(sample->map, sample->map_size);
+    munmap(sample->map, sample->map_size);
+}
+
+#endif
+
+// Touch every page so the audio thread never takes a page fault on a mapping
+static void prefault(const Uint8 *memory, size_t size)
+{
+    volatile Uint8 sum = 0;
+    for (size_t i = 0; i < size; i += 4096)
+        sum += memory[i];
+    (void)sum;
+}
+
+bool sampler_load(Sampler *sampler, const char *path, int root)
+{
+    SampleData *sample = &sampler->samples[sampler->sample_count];
+    WavInfo info;
+
+    if (sampler->sample_count == SAMPLER_MAX_SAMPLES)
+        return false;
+
+    FILE *file = fopen(path, "rb");
+    if (!file || !wav_read_info(file, &info) || info.frames == 0)
+    {
+        SDL_Log("Cannot load sample %s, expected 16-bit or float WAV", path);
+        if (file)
+            fclose(file);
+        return false;
+    }
+
+    SDL_zerop(sample);
+    sample->root = root;
+    sample->sample_rate = info.sample_rate;
+    sample->channels = info.channels;
+    sample->bytes_per_sample = info.bytes_per_sample;
+    sample->is_float = info.is_float;
+    sample->frames = info.frames;
+    sample->data_offset = info.data_offset;
+
+    size_t frame_bytes = (size_t)info.bytes_per_sample * info.channels;
+    size_t data_bytes = (size_t)info.frames * frame_bytes;
+
+    if ((size_t)info.data_offset + data_bytes <= SAMPLER_MAP_LIMIT)
+    {
+        fclose(file);
+        if (!map_file(sample, path) || (size_t)info.data_offset + data_bytes > sample->map_size)
+        {
+            SDL_Log("Cannot map sample %s", path);
+            if (sample->map)
+                unmap_file(sample);
+            return false;
+        }
+        sample->memory = (const Uint8 *)sample->map + info.data_offset;
+        sample->memory_frames = info.frames;
+        prefault(sample->memory, data_bytes);
+    }
+    else
+    {
+        // Only the head is read now, so huge libraries load quickly
+        Uint32 preload = SDL_min(info.frames, (Uint32)SAMPLER_PRELOAD_FRAMES);
+        Uint8 *head = SDL_malloc(preload * frame_bytes);
+        if (!head || fseek(file, info.data_offset, SEEK_SET) != 0 ||
+            fread(head, frame_bytes, preload, file) != preload)
+        {
+            SDL_Log("Cannot read sample %s", path);
+            SDL_free(head);
+            fclose(file);
+            return false;
+        }
+        sample->memory = head;
+        sample->memory_frames = preload;
+        sample->file = file;
+        sampler->streaming = sampler->streaming || preload < info.frames;
+    }
+
+    sampler->sample_count++;
+    return true;
+}
+
+// Frame `index` of the in-memory part, mixed to mono
+static inline float memory_frame(const SampleData *sample, Uint32 index)
+{
+    const Uint8 *p = sample->memory + (size_t)index * sample->channels * sample->bytes_per_sample;
+    float sum = 0.0f;
+
+    for (int c = 0; c < sample->channels; c++)
+    {
+        if (sample->is_float)
+        {
+            float value;
+            SDL_memcpy(&value, p + c * 4, 4);
+            sum += SDL_SwapFloatLE(value);
+        }
+        else
+        {
+            Sint16 value;
+            SDL_memcpy(&value, p + c * 2, 2);
+            sum += (Sint16)SDL_SwapLE16(value) * (1.0f / 32768.0f);
+        }
+    }
+    return sample->channels == 1 ? sum : sum / sample->channels;
+}
+
+// Prefetch thread: read the next chunk of a stream from disk into its ring
+static void fill_stream(SampleStream *stream)
+{
+    const SampleData *sample = stream->current;
+    Uint8 buffer[SAMPLER_PREFETCH_FRAMES * 4 * 2]; // Stereo float, wider layouts read fewer frames
+    int frame_bytes = sample->bytes_per_sample * sample->channels;
+    int chunk = (int)(sizeof(buffer) / frame_bytes);
+
+    for (;;)
+    {
+        Uint32 write = (Uint32)SDL_AtomicGet(&stream->write);
+        Uint32 space = SAMPLER_RING_FRAMES - (write - (Uint32)SDL_AtomicGet(&stream->read));
+        Uint32 left = sample->frames - stream->file_frame;
+        int count = (int)SDL_min(SDL_min(space, left), (Uint32)chunk);
+
+        if (space > SAMPLER_RING_FRAMES || count <= 0)
+            return;
+
+        long offset = sample->data_offset + (long)stream->file_frame * frame_bytes;
+        if (fseek(sample->file, offset, SEEK_SET) != 0 ||
+            fread(buffer, frame_bytes, (size_t)count, sample->file) != (size_t)count)
+        {
+            stream->file_frame = sample->frames; // Truncated file, the rest plays as silence
+            return;
+        }
+
+        // Same mono mixdown as memory_frame(), using a temporary view
+        SampleData view = *sample;
+        view.memory = buffer;
+        for (int i = 0; i < count; i++)
+            stream->ring[(write + i) & RING_MASK] = memory_frame(&view, (Uint32)i);
+
+        stream->file_frame += count;
+        SDL_MemoryBarrierRelease();
+        SDL_AtomicSet(&stream->write, (int)(write + count));
+
+        // A new request means this data is stale, let the main loop reset
+        if (SDL_AtomicGet(&stream->generation) != stream->seen)
+            return;
+    }
+}
+
+static int prefetch_main(void *data)
+{
+    Sampler *sampler = data;
+
+    while (SDL_AtomicGet(&sampler->running))
+    {
+        SDL_SemWaitTimeout(sampler->wake, SAMPLER_PREFETCH_MS);
+
+        for (int v = 0; v < sampler->stream_count; v++)
+        {
+            SampleStream *stream = &sampler->streams[v];
+            int generation = SDL_AtomicGet(&stream->generation);
+
+            if (generation != stream->seen)
+            {
+                SDL_MemoryBarrierAcquire();
+                stream->seen = generation;
+                stream->current = SDL_AtomicGetPtr(&stream->request);
+                stream->file_frame = stream->current ? stream->current->memory_frames : 0;
+                SDL_AtomicSet(&stream->write, 0);
+                SDL_MemoryBarrierRelease();
+                SDL_AtomicSet(&stream->ready, generation);
+            }
+            if (stream->current && stream->current->file)
+                fill_stream(stream);
+        }
+    }
+    return 0;
+}
+
+bool sampler_start(Sampler *sampler, int players)
+{
+    sampler->stream_count = SDL_clamp(players, 1, SAMPLER_MAX_PLAYERS) * SYNTH_MAX_VOICES;
+    if (!sampler->streaming)
+        return true;
+
+    sampler->rings = SDL_calloc((size_t)sampler->stream_count * SAMPLER_RING_FRAMES, sizeof(float));
+    sampler->wake = SDL_CreateSemaphore(0);
+    if (!sampler->rings || !sampler->wake)
+        return false;
+    for (int v = 0; v < sampler->stream_count; v++)
+        sampler->streams[v].ring = sampler->rings + (size_t)v * SAMPLER_RING_FRAMES;
+
+    SDL_AtomicSet(&sampler->running, 1);
+    sampler->thread = SDL_CreateThread(prefetch_main, "sample prefetch", sampler);
+    if (!sampler->thread)
+    {
+        SDL_Log("Error creating prefetch thread: %s", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void sampler_close(Sampler *sampler)
+{
+    if (sampler->thread)
+    {
+        SDL_AtomicSet(&sampler->running, 0);
+        SDL_SemPost(sampler->wake);
+        SDL_WaitThread(sampler->thread, NULL);
+    }
+    if (sampler->wake)
+        SDL_DestroySemaphore(sampler->wake);
+    if (SDL_AtomicGet(&sampler->underruns) > 0)
+        SDL_Log("Sample streaming fell behind in %d blocks", SDL_AtomicGet(&sampler->underruns));
+
+    for (int i = 0; i < sampler->sample_count; i++)
+    {
+        SampleData *sample = &sampler->samples[i];
+        if (sample->map)
+            unmap_file(sample);
+        if (sample->file)
+        {
+            fclose(sample->file);
+            SDL_free((void *)sample->memory);
+        }
+    }
+    SDL_free(sampler->rings);
+    SDL_zerop(sampler);
+}
+
+const SampleData *sampler_pick(const Sampler *sampler, int note)
+{
+    const SampleData *best = NULL;
+
+    for (int i = 0; i < sampler->sample_count; i++)
+    {
+        const SampleData *sample = &sampler->samples[i];
+        if (!best || SDL_abs(sample->root - note) < SDL_abs(best->root - note))
+            best = sample;
+    }
+    return best;
+}
+
+void sampler_voice_start(Sampler *sampler, int voice, const SampleData *sample)
+{
+    SampleStream *stream = &sampler->streams[voice];
+
+    if (!sampler->thread)
+        return;
+
+    // The read position is reset before the request is published, the
+    // prefetch thread resets the write position when it takes it
+    SDL_AtomicSet(&stream->read, 0);
+    SDL_AtomicSetPtr(&stream->request, (void *)sample);
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicIncRef(&stream->generation);
+    if (sample && sample->file)
+        SDL_SemPost(sampler->wake);
+}
+
+void sampler_voice_stop(Sampler *sampler, int voice)
+{
+    sampler_voice_start(sampler, voice, NULL);
+}
+
+// Frame `index` wherever it lives, flags frames the stream has not reached
+static inline float frame_at(const SampleData *sample, const SampleStream *stream, Uint32 index, Uint32 available,
+                             bool *missing)
+{
+    if (index < sample->memory_frames)
+        return memory_frame(sample, index);
+    if (index >= sample->frames)
+        return 0.0f;
+    if (index < available)
+        return stream->ring[(index - sample->memory_frames) & RING_MASK];
+    *missing = true;
+    return 0.0f;
+}
+
+Uint64 sampler_render_voice(Sampler *sampler, int voice, const SampleData *sample, float *mix, Uint64 pos,
+                            Uint64 step, float gain, float gain_step, int frames)
+{
+    SampleStream *stream = &sampler->streams[voice];
+    Uint32 preload = sample->memory_frames;
+    Uint32 available = preload, written = 0;
+    bool missing = false;
+
+    // Streamed frames past the preload that the ring already holds
+    if (sample->file && SDL_AtomicGet(&stream->ready) == SDL_AtomicGet(&stream->generation))
+    {
+        written = (Uint32)SDL_AtomicGet(&stream->write);
+        SDL_MemoryBarrierAcquire();
+        available = preload + written;
+    }
+
+    for (int i = 0; i < frames; i++)
+    {
+        Uint32 index = (Uint32)(pos >> 32);
+        if (index >= sample->frames)
+            break;
+
+        // Linear interpolation, frames not streamed in yet play as silence
+        float a = frame_at(sample, stream, index, available, &missing);
+        float b = frame_at(sample, stream, index + 1, available, &missing);
+        float frac = (Uint32)pos * (1.0f / 4294967296.0f);
+        mix[i] += gain * (a + (b - a) * frac);
+        gain += gain_step;
+        pos += step;
+    }
+
+    if (sample->file)
+    {
+        // Release what has been played, keeping the frame under the read
+        // head for interpolation. Never pass the writer, it only fills
+        // frames in order.
+        Uint32 index = (Uint32)(pos >> 32);
+        if (index > preload)
+            SDL_AtomicSet(&stream->read, (int)SDL_min(index - preload - 1, written));
+        if (missing)
+            SDL_AtomicIncRef(&sampler->underruns);
+    }
+    return pos;
+}
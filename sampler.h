@@ -0,0 +1,113 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <SDL.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "synth.h"
+
+#define SAMPLER_MAX_SAMPLES 32           // Samples per instrument
+#define SAMPLER_MAX_PLAYERS 4            // Synths sharing one sampler
+#define SAMPLER_MAP_LIMIT (16 << 20)     // Files up to this size are mapped whole, larger ones stream
+#define SAMPLER_PRELOAD_FRAMES 32768     // Head of a streamed sample kept in memory
+#define SAMPLER_RING_FRAMES 65536        // Per-voice stream buffer, must be a power of two
+#define SAMPLER_PREFETCH_FRAMES 4096     // Frames read per disk access
+#define SAMPLER_PREFETCH_MS 5            // Prefetch thread wake-up interval
+
+// One WAV sample. Small files are memory-mapped and fully paged in at load,
+// so playing them never faults. Large files only load their header and the
+// first SAMPLER_PRELOAD_FRAMES frames; the rest streams in while playing.
+// Either way `memory` holds the first `memory_frames` frames, in the file's
+// own format, ready for the audio thread.
+typedef struct SampleData
+{
+    int root;         // MIDI note recorded at the file's own pitch
+    int sample_rate;
+    int channels;
+    int bytes_per_sample; // 2 for 16-bit PCM, 4 for float
+    bool is_float;
+    Uint32 frames;
+    Uint32 memory_frames;
+    const Uint8 *memory;
+
+    // Mapped files
+    void *map;
+    size_t map_size;
+#ifdef _WIN32
+    void *map_handle;
+#endif
+
+    // Streamed files, only the prefetch thread reads from `file`
+    FILE *file;
+    long data_offset;
+} SampleData;
+
+// Per-voice stream. The audio thread asks for a sample by storing it and
+// bumping `generation`; the prefetch thread resets the ring and answers
+// through `ready`, then keeps it filled. `write` is only advanced by the
+// prefetch thread and `read` by the audio thread, both count frames past
+// the preload, mixed down to mono float.
+typedef struct SampleStream
+{
+    SDL_atomic_t generation;
+    SDL_atomic_t ready;
+    SDL_atomic_t write;
+    SDL_atomic_t read;
+    void *request; // const SampleData *, NULL stops the stream
+
+    // Prefetch thread side
+    int seen;
+    const SampleData *current;
+    Uint32 file_frame;
+
+    float *ring;
+} SampleStream;
+
+typedef struct Sampler
+{
+    SampleData samples[SAMPLER_MAX_SAMPLES];
+    int sample_count;
+    bool streaming; // Some sample is too large to map
+
+    // SYNTH_MAX_VOICES streams per player, see sampler_start()
+    SampleStream streams[SAMPLER_MAX_PLAYERS * SYNTH_MAX_VOICES];
+    int stream_count;
+    float *rings;
+
+    SDL_Thread *thread;
+    SDL_sem *wake;
+    SDL_atomic_t running;
+    SDL_atomic_t underruns; // Blocks where a stream had not caught up
+} Sampler;
+
+void sampler_init(Sampler *sampler);
+
+// Main thread, before sampler_start(): add a WAV file played at its own
+// pitch on MIDI note `root`
+bool sampler_load(Sampler *sampler, const char *path, int root);
+
+// Allocate the stream buffers and start the prefetch thread if needed.
+// The sample memory and the prefetch thread are shared by `players` synths,
+// player p streams its voices from p * SYNTH_MAX_VOICES on, see
+// Synth.stream_base.
+bool sampler_start(Sampler *sampler, int players);
+void sampler_close(Sampler *sampler);
+
+// Sample with the root nearest to `note`, NULL if none is loaded
+const SampleData *sampler_pick(const Sampler *sampler, int note);
+
+// Audio thread: bind stream `voice` to a sample from its first frame, or release it
+void sampler_voice_start(Sampler *sampler, int voice, const SampleData *sample);
+void sampler_voice_stop(Sampler *sampler, int voice);
+
+// Audio thread: add `frames` of `sample`, the one the voice was started
+// with, into `mix`, mono, at the 32.32 fixed point position `pos` advancing
+// by `step` per frame, with the same gain ramp as the oscillators. Returns
+// the new position, at or past the sample's end once it has finished.
+// Frames not yet streamed in play as silence and count as an underrun, the
+// call never waits.
+Uint64 sampler_render_voice(Sampler *sampler, int voice, const SampleData *sample, float *mix, Uint64 pos,
+                            Uint64 step, float gain, float gain_step, int frames);
+
+#endif
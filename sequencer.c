@@ -0,0 +1,274 @@
+#include "sequencer.h"
+
+#include <math.h>
+
+#define SEQ_FRESH 4 // Flag next to the shared slot index
+#define SEQ_VELOCITY 100
+#define SEQ_MIN_TEMPO 1.0f
+
+void sequencer_pattern_init(SequencerPattern *pattern, int mode, float tempo, int length)
+{
+    SDL_zerop(pattern);
+    pattern->tempo = tempo;
+    pattern->mode = (Uint8)mode;
+    pattern->steps_per_beat = 4;
+    pattern->length = (Uint8)SDL_min(SDL_max(length, 1), SEQ_MAX_STEPS);
+    pattern->root = 60;
+    for (int s = 0; s < pattern->length; s++)
+    {
+        pattern->steps[s].velocity = SEQ_VELOCITY;
+        pattern->steps[s].gate = SEQ_GATE_UNITS / 2;
+    }
+}
+
+bool sequencer_pattern_parse(SequencerPattern *pattern, const char *text)
+{
+    int length = 0;
+    SequencerStep *tied = NULL; // Step the next "-" extends
+
+    while (*text)
+    {
+        if (*text == ' ')
+        {
+            text++;
+            continue;
+        }
+        if (length == SEQ_MAX_STEPS)
+            return false;
+
+        SequencerStep *step = &pattern->steps[length++];
+        step->note = 0;
+        step->velocity = 0;
+        step->gate = SEQ_GATE_UNITS / 2;
+
+        if (*text == '-' && (text[1] == ' ' || text[1] == '\0'))
+        {
+            if (!tied || tied->gate > 255 - SEQ_GATE_UNITS)
+                return false;
+            // A tied note holds through the whole step it started in
+            tied->gate = (Uint8)(SDL_max(tied->gate, SEQ_GATE_UNITS) + SEQ_GATE_UNITS);
+            text++;
+        }
+        else if (*text == '.')
+        {
+            tied = NULL;
+            text++;
+        }
+        else
+        {
+            char *end;
+            long note = SDL_strtol(text, &end, 10);
+            if (end == text || note < -SYNTH_NOTES || note > SYNTH_NOTES || (*end != ' ' && *end != '\0'))
+                return false;
+            step->note = (Sint8)note;
+            step->velocity = SEQ_VELOCITY;
+            tied = step;
+            text = end;
+        }
+    }
+
+    if (length == 0)
+        return false;
+    pattern->length = (Uint8)length;
+    return true;
+}
+
+static double step_frames(const Sequencer *sequencer, const SequencerPattern *pattern)
+{
+    double tempo = SDL_max(pattern->tempo, SEQ_MIN_TEMPO);
+    return sequencer->sample_rate * 60.0 / (tempo * SDL_max(pattern->steps_per_beat, 1));
+}
+
+void sequencer_init(Sequencer *sequencer, int sample_rate)
+{
+    SDL_zerop(sequencer);
+    sequencer->sample_rate = sample_rate;
+    for (int s = 0; s < SEQ_PATTERN_SLOTS; s++)
+        sequencer_pattern_init(&sequencer->slots[s], SEQ_OFF, 120.0f, 1);
+    sequencer->edit = 0;
+    SDL_AtomicSet(&sequencer->middle, 1);
+    sequencer->playing = 2;
+    sequencer->frames_per_step = step_frames(sequencer, &sequencer->slots[sequencer->playing]);
+}
+
+void sequencer_publish(Sequencer *sequencer, const SequencerPattern *pattern)
+{
+    sequencer->slots[sequencer->edit] = *pattern;
+
+    // Publish the pattern before the slot index
+    SDL_MemoryBarrierRelease();
+    sequencer->edit = SDL_AtomicSet(&sequencer->middle, sequencer->edit | SEQ_FRESH) & (SEQ_FRESH - 1);
+}
+
+static void end_note(Sequencer *sequencer, Synth *synth, int index)
+{
+    synth_note_off(synth, sequencer->sounding[index].note);
+    sequencer->sounding[index] = sequencer->sounding[--sequencer->sounding_count];
+}
+
+void sequencer_update(Sequencer *sequencer, Synth *synth)
+{
+    if (!(SDL_AtomicGet(&sequencer->middle) & SEQ_FRESH))
+        return;
+
+    int was = sequencer->slots[sequencer->playing].mode;
+    double old_frames = sequencer->frames_per_step;
+
+    // Only the UI sets the flag, so the slot taken here is the fresh one
+    sequencer->playing = SDL_AtomicSet(&sequencer->middle, sequencer->playing) & (SEQ_FRESH - 1);
+    SDL_MemoryBarrierAcquire();
+
+    const SequencerPattern *pattern = &sequencer->slots[sequencer->playing];
+    sequencer->frames_per_step = step_frames(sequencer, pattern);
+    sequencer->step %= pattern->length;
+
+    if (was == SEQ_OFF)
+    {
+        // Starting: the first step plays at the top of this buffer
+        sequencer->until_step = 0.0;
+        sequencer->step = 0;
+        sequencer->arp_index = 0;
+    }
+    else
+    {
+        // Same point in the step at the new tempo
+        sequencer->until_step *= sequencer->frames_per_step / old_frames;
+    }
+
+    if (pattern->mode == SEQ_OFF)
+    {
+        while (sequencer->sounding_count > 0)
+            end_note(sequencer, synth, 0);
+    }
+    if (pattern->mode < SEQ_ARP_UP)
+        sequencer->held_count = 0;
+}
+
+bool sequencer_busy(const Sequencer *sequencer)
+{
+    int mode = sequencer->slots[sequencer->playing].mode;
+    return mode == SEQ_STEP || (mode >= SEQ_ARP_UP && sequencer->held_count > 0) || sequencer->sounding_count > 0;
+}
+
+bool sequencer_take_event(Sequencer *sequencer, const SynthEvent *event)
+{
+    if (sequencer->slots[sequencer->playing].mode < SEQ_ARP_UP || event->type == EVENT_PARAM)
+        return false;
+
+    if (event->type == EVENT_CONTROL)
+    {
+        // Forget the keys, the synth still handles the controller
+        if (event->note == CC_ALL_NOTES_OFF || event->note == CC_ALL_SOUND_OFF)
+            sequencer->held_count = 0;
+        if (event->note == CC_ALL_SOUND_OFF)
+            sequencer->sounding_count = 0;
+        return false;
+    }
+
+    int at = 0;
+    while (at < sequencer->held_count && sequencer->held[at] < event->note)
+        at++;
+    bool found = at < sequencer->held_count && sequencer->held[at] == event->note;
+
+    if (event->type == EVENT_NOTE_ON && event->value > 0)
+    {
+        if (!found && sequencer->held_count < SEQ_MAX_HELD)
+        {
+            // The first key restarts the pattern, on its own frame
+            if (sequencer->held_count == 0)
+            {
+                sequencer->arp_index = 0;
+                sequencer->step = 0;
+                sequencer->until_step = 0.0;
+            }
+            SDL_memmove(sequencer->held + at + 1, sequencer->held + at, sequencer->held_count - at);
+            sequencer->held[at] = event->note;
+            sequencer->held_count++;
+        }
+        return true;
+    }
+
+    // A key that went down before the arpeggiator started is the synth's to release
+    if (!found)
+        return false;
+    sequencer->held_count--;
+    SDL_memmove(sequencer->held + at, sequencer->held + at + 1, sequencer->held_count - at);
+    return true;
+}
+
+int sequencer_next(const Sequencer *sequencer, int frames)
+{
+    int next = frames;
+
+    if (sequencer->slots[sequencer->playing].mode != SEQ_OFF)
+        next = SDL_min(next, (int)ceil(sequencer->until_step));
+    for (int i = 0; i < sequencer->sounding_count; i++)
+        next = SDL_min(next, sequencer->sounding[i].remaining);
+    return SDL_max(next, 0);
+}
+
+// Held key the arpeggiator plays next
+static int arp_note(Sequencer *sequencer, int mode)
+{
+    int count = sequencer->held_count;
+    int index = sequencer->arp_index++ % (mode == SEQ_ARP_UPDOWN && count > 1 ? 2 * count - 2 : count);
+
+    if (mode == SEQ_ARP_DOWN)
+        index = count - 1 - index;
+    else if (index >= count)
+        index = 2 * count - 2 - index; // Coming back down
+    return sequencer->held[index];
+}
+
+static void play_step(Sequencer *sequencer, Synth *synth)
+{
+    const SequencerPattern *pattern = &sequencer->slots[sequencer->playing];
+    const SequencerStep *step = &pattern->steps[sequencer->step];
+    sequencer->step = (sequencer->step + 1) % pattern->length;
+
+    if (step->velocity == 0)
+        return;
+
+    int note;
+    if (pattern->mode == SEQ_STEP)
+        note = pattern->root + step->note;
+    else if (sequencer->held_count > 0)
+        note = arp_note(sequencer, pattern->mode) + step->note;
+    else
+        return;
+    if (note < 0 || note >= SYNTH_NOTES)
+        return;
+
+    // Retrigger a note still gated, and end another one when all are taken
+    for (int i = sequencer->sounding_count - 1; i >= 0; i--)
+        if (sequencer->sounding[i].note == note)
+            end_note(sequencer, synth, i);
+    if (sequencer->sounding_count == SEQ_MAX_SOUNDING)
+        end_note(sequencer, synth, 0);
+
+    synth_note_on(synth, note, SDL_min(step->velocity, 127));
+    SequencerNote *sounding = &sequencer->sounding[sequencer->sounding_count++];
+    sounding->note = (Uint8)note;
+    sounding->remaining = SDL_max((int)(step->gate * sequencer->frames_per_step / SEQ_GATE_UNITS), 1);
+}
+
+void sequencer_advance(Sequencer *sequencer, Synth *synth, int frames)
+{
+    // Note offs first, a note ending on a step boundary frees its voice for the step
+    for (int i = sequencer->sounding_count - 1; i >= 0; i--)
+    {
+        sequencer->sounding[i].remaining -= frames;
+        if (sequencer->sounding[i].remaining <= 0)
+            end_note(sequencer, synth, i);
+    }
+
+    if (sequencer->slots[sequencer->playing].mode == SEQ_OFF)
+        return;
+
+    sequencer->until_step -= frames;
+    while (sequencer->until_step <= 0.0)
+    {
+        play_step(sequencer, synth);
+        sequencer->until_step += sequencer->frames_per_step;
+    }
+}
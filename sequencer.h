@@ -0,0 +1,107 @@
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <SDL.h>
+#include <stdbool.h>
+
+#include "synth.h"
+
+#define SEQ_MAX_STEPS 64
+#define SEQ_MAX_HELD 16     // Keys the arpeggiator keeps track of
+#define SEQ_MAX_SOUNDING 8  // Notes still gated from earlier steps
+#define SEQ_PATTERN_SLOTS 3 // UI edit, hand-over and playing copy
+#define SEQ_GATE_UNITS 16   // Step gate resolution, 16 is a full step
+
+enum
+{
+    SEQ_OFF = 0,
+    SEQ_STEP,     // Play the steps as notes relative to the pattern root
+    SEQ_ARP_UP,   // Step through the held keys, lowest first
+    SEQ_ARP_DOWN, // Highest first
+    SEQ_ARP_UPDOWN
+};
+
+// One step. A velocity of 0 is a rest. In step mode `note` is added to the
+// pattern root, in the arpeggiator modes to the key it picks; either way a
+// step can shift by octaves or play intervals.
+typedef struct SequencerStep
+{
+    Sint8 note;
+    Uint8 velocity;
+    Uint8 gate; // Note length in 1/SEQ_GATE_UNITS of a step, over 16 ties into the next steps
+} SequencerStep;
+
+typedef struct SequencerPattern
+{
+    float tempo;         // Beats per minute
+    Uint8 mode;          // SEQ_OFF, SEQ_STEP or an arpeggiator mode
+    Uint8 steps_per_beat;
+    Uint8 length;        // Steps before the pattern repeats, 1..SEQ_MAX_STEPS
+    Uint8 root;          // MIDI note of step note 0 in step mode
+    SequencerStep steps[SEQ_MAX_STEPS];
+} SequencerPattern;
+
+typedef struct SequencerNote
+{
+    Uint8 note;
+    int remaining; // Frames until its note off
+} SequencerNote;
+
+// Step sequencer and arpeggiator clocked by rendered frames, so steps fall on
+// exact sample positions whatever the buffer size. The UI thread publishes
+// whole patterns through a triple buffer: it fills its own slot, then swaps
+// it with the shared one, and the audio thread swaps that with its playing
+// copy at the start of a buffer. No pattern is ever allocated or locked.
+typedef struct Sequencer
+{
+    SDL_atomic_t middle; // Shared slot index, with a flag once the UI published it
+    int edit;            // UI thread
+    int playing;         // Audio thread
+    SequencerPattern slots[SEQ_PATTERN_SLOTS];
+
+    // Audio thread
+    int sample_rate;
+    double frames_per_step;
+    double until_step; // Frames to the start of the next step
+    int step;
+    Uint8 held[SEQ_MAX_HELD]; // Keys down in arpeggiator modes, ascending
+    int held_count;
+    int arp_index;
+    SequencerNote sounding[SEQ_MAX_SOUNDING];
+    int sounding_count;
+} Sequencer;
+
+void sequencer_init(Sequencer *sequencer, int sample_rate);
+
+// Fill in a pattern of `length` sixteenth steps from middle C, each playing
+// note 0 for half a step
+void sequencer_pattern_init(SequencerPattern *pattern, int mode, float tempo, int length);
+
+// Parse steps from `text`, separated by spaces: a note offset in semitones
+// such as 0, 7 or -12, "." for a rest or "-" to tie the previous note over
+// one more step. The rest of the pattern is left as it is.
+bool sequencer_pattern_parse(SequencerPattern *pattern, const char *text);
+
+// UI thread: hand `pattern` to the audio thread, it takes effect at the next
+// buffer. The step position and timing carry over, so tempo or mode changes
+// stay in time.
+void sequencer_publish(Sequencer *sequencer, const SequencerPattern *pattern);
+
+// Audio thread, start of a buffer: pick up a published pattern
+void sequencer_update(Sequencer *sequencer, Synth *synth);
+
+// Audio thread: false when nothing can play, so the synth may go idle
+bool sequencer_busy(const Sequencer *sequencer);
+
+// Audio thread: offer a note event, returns true when the arpeggiator took
+// the key instead of the synth
+bool sequencer_take_event(Sequencer *sequencer, const SynthEvent *event);
+
+// Audio thread: frames until the next step or note off, at most `frames`
+int sequencer_next(const Sequencer *sequencer, int frames);
+
+// Audio thread: move the clock on by `frames`, which must not pass
+// sequencer_next(), and play whatever falls due at the new position
+void sequencer_advance(Sequencer *sequencer, Synth *synth, int frames);
+
+#endif
@@ -3,100 +3,1002 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#include "analyzer.h"
+#include "audio_memory.h"
+#include "audio_stats.h"
+#include "event_queue.h"
+#include "graph.h"
+#include "midi_input.h"
+#include "offline.h"
+#include "osc_input.h"
+#include "patch.h"
+#include "render_pool.h"
+#include "sampler.h"
+#include "sequencer.h"
+#include "synth.h"
+#include "tap.h"
+#include "trace.h"
+#include "ui.h"
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
 #define SAMPLE_RATE 44100
+#define BUFFER_FRAMES 1024      // Default device buffer, about 23 ms at 44100 Hz
+#define LOW_LATENCY_FRAMES 128  // Low-latency mode target, clamped to 64..256
+#define QUEUE_DEPTH 4           // Push mode: buffers kept queued on the device
+#define COMPARE_TOLERANCE 2     // --compare: 16-bit steps a render may differ from its golden file
+#define IDLE_PAUSE 10           // Seconds of silence before the device is paused
+#define CHANNELS 2              // Output channels requested by default
+#define AUDIO_ARENA_BYTES (4 << 20) // Preallocated audio-side memory
+#define SAMPLE_ROOT 60          // Default root note of a --sample file, middle C
+#define TEMPO 120.0f            // Sequencer beats per minute
+#define TEMPO_STEP 5.0f         // Up / Down arrow tempo change
+#define MIN_TEMPO 20.0f
+#define MAX_TEMPO 300.0f
 #define AMPLITUDE 28000
-#define FREQUENCY_A4 440.0 // Frequency for A4 note (440 Hz)
+#define PATCH_POLL_MS 250 // Patch file check interval
+#define MAX_OUTPUTS 4     // Devices one process plays on, at most EVENT_FANOUT_MAX and SAMPLER_MAX_PLAYERS
 
 // Window dimensions
 #define WINDOW_WIDTH 400
 #define WINDOW_HEIGHT 300
+#define WINDOW_TITLE "(z-m / q-p keys) SDL Sinusoidal Synthesizer"
+#define TITLE_INTERVAL 1000 // Milliseconds between audio load updates in the title
+#define UI_POLL_MS 10       // Output tap check interval while levels are on display
+#define UI_IDLE_POLL_MS 50  // The same while the display is blank
+
+// Command-line options
+typedef struct Options
+{
+    int sample_rate;
+    int buffer_frames;
+    bool low_latency;
+    int queue_depth; // 0 for the pull callback, otherwise push mode depth in buffers
+    const char *render_path; // Headless mode: WAV file to write
+    const char *script_path; // Headless mode: note script to play
+    const char *golden_path; // Headless mode: earlier render to compare against
+    int tolerance;           // Largest difference from it, in 16-bit steps
+    bool midi;               // Open MIDI input
+    const char *midi_port;   // MIDI source, NULL for the backend default
+    int osc_port;            // OSC over UDP, 0 for none
+    int idle_pause;          // Seconds of silence before pausing the device, 0 never
+    bool dither;             // TPDF dither when the device only takes Sint16
+    int threads;             // Render worker threads besides the audio thread
+    int channels;            // Output channels to request
+    float spread;            // Pan steps per semitone, see Synth.pan_spread
+    float cutoff;            // Voice filter, 0 for none, see synth_set_filter()
+    float resonance;
+    float filter_env;
+    const char *sample_paths[SAMPLER_MAX_SAMPLES]; // WAV instrument, plays instead of the sine
+    int sample_roots[SAMPLER_MAX_SAMPLES];
+    int sample_count;
+    int sequencer_mode;      // SEQ_OFF leaves the sequencer stopped until Space
+    const char *pattern;     // Sequencer steps, see sequencer_pattern_parse()
+    float tempo;
+    const char *graph;       // DSP graph after the voices, see graph_parse()
+    const char *patch;       // Patch file, watched and reloaded while playing
+    const char *trace_path;  // Chrome trace written on exit, NULL for none
+    const char *output_devices[MAX_OUTPUTS]; // Device names, NULL for the default device
+    Uint8 output_zones[MAX_OUTPUTS][2];      // Lowest and highest note each device plays
+    int output_count;
+} Options;
+
+// One audio device and the engine that renders for it. Every output has its
+// own audio thread, voices, graph and sequencer; the wavetable and the
+// loaded samples exist once and are shared read-only by all of them.
+typedef struct Output
+{
+    const char *name;      // NULL for the default device
+    SDL_AudioDeviceID device;
+    SDL_AudioSpec spec;    // What the device granted
+    Synth synth;
+    EventQueue note_queue; // Main thread -> audio thread
+    EventQueue midi_queue; // MIDI input thread -> audio thread
+    EventQueue osc_queue;  // OSC input thread -> audio thread
+    AudioStats stats;      // Written by the audio thread, read by the main thread
+    RenderPool *pool;      // Helpers for the audio thread, see --threads
+    Sequencer sequencer;   // Audio thread side, see sequencer_publish()
+    Graph graph;
+    Tap *tap;              // Output for the display, only the first output has one
+    bool paused;           // Under pause_lock
+
+    // Push mode, the render thread feeds the device through SDL_QueueAudio
+    SDL_Thread *render_thread;
+    int render_underruns; // Times the device queue ran dry
+} Output;
+
+Output outputs[MAX_OUTPUTS];
+int output_count = 0;
+EventFanout note_targets; // Main thread -> every output
+EventFanout midi_targets;
+EventFanout osc_targets;
+// Fixed audio-side buffers are allocated up front in the arena; graph plans
+// are allocated whole off the audio threads and handed over, so nothing on
+// their side touches the heap while playing
+AudioArena audio_arena;
+Sampler sampler;          // Shared by every output
+SequencerPattern pattern; // Main thread copy, edited by the keys and published whole
+int sequencer_mode;       // Mode Space starts
+Patch patch;            // Main thread copy of the settings last loaded
+PatchWatch patch_watch;
+Tap output_tap;    // First output for the display, written by its audio thread
+Analyzer analyzer; // Main thread side of the tap
+Ui ui;
+Uint8 keys_down[SYNTH_NOTES]; // Keys held per note, the rows overlap on C5..E5; labelled in the window
+char output_label[64];       // Device format line at the bottom of the window
+
+// Auto-pause: the main thread pauses a device once its synth reports it has
+// been idle, any input thread resumes them all before queueing a note
+SDL_mutex *pause_lock = NULL;
+SDL_atomic_t last_input; // SDL_GetTicks() of the latest note input
+Uint32 idle_pause_ms = 0;
 
-SDL_AudioDeviceID audio_device;
-bool note_on = false;
-double phase = 0.0;
-double frequency = FREQUENCY_A4;
-const char *note_name = "A"; // Current note name
+TraceRing *main_trace = NULL; // Window frames, NULL unless --trace
 
-// Audio callback function for generating a sinusoidal wave
+// Push mode, one render thread per output
+SDL_atomic_t render_running;
+int render_depth; // Target queue depth in buffers
+
+// Audio callback function, mixes every active voice of the output's synth
 void audio_callback(void *userdata, Uint8 *stream, int len)
 {
-    Sint16 *buffer = (Sint16 *)stream;
-    int length = len / 2; // Length in samples (Sint16 is 2 bytes)
-    double phase_increment = 2.0 * M_PI * frequency / SAMPLE_RATE;
+    Output *output = userdata;
+    int length = len / output->synth.frame_bytes; // Length in frames
+
+    trace_begin(output->synth.trace, "audio_callback");
+    Uint64 start = audio_stats_begin(&output->stats);
+    audio_memory_enter_rt();
+    synth_process(&output->synth, stream, length);
+    if (output->tap)
+        tap_write(output->tap, stream, length);
+    audio_memory_leave_rt();
+    audio_stats_end(&output->stats, start, length);
+    trace_end(output->synth.trace, "audio_callback");
+}
+
+// Push mode render thread. It renders one buffer at a time whenever the
+// device queue drops below the target depth, so expensive DSP is not bound
+// to the device callback's deadline. SDL copies what we queue, so the device
+// queue itself is the ring of pre-rendered buffers.
+int render_thread_main(void *data)
+{
+    Output *output = data;
+    int render_frames = output->spec.samples;
+    Uint32 buffer_bytes = render_frames * output->synth.frame_bytes;
+    Uint32 high_water = render_depth * buffer_bytes;
+    Uint32 period_ms = 1000 * render_frames / output->synth.sample_rate;
+    void *buffer = SDL_malloc(buffer_bytes);
+    bool started = false;
+
+    if (!buffer)
+        return -1;
 
-    for (int i = 0; i < length; i++)
+    // SDL already raises its own audio thread, do the same for ours
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_TIME_CRITICAL);
+
+    while (SDL_AtomicGet(&render_running))
     {
-        if (note_on)
+        Uint32 queued = SDL_GetQueuedAudioSize(output->device);
+        if (queued == 0 && started)
+            output->render_underruns++;
+
+        if (queued + buffer_bytes <= high_water)
         {
-            buffer[i] = (Sint16)(AMPLITUDE * sin(phase));
-            phase += phase_increment;
-            if (phase >= 2.0 * M_PI)
-            {
-                phase -= 2.0 * M_PI;
-            }
+            trace_begin(output->synth.trace, "render_buffer");
+            Uint64 start = audio_stats_begin(&output->stats);
+            audio_memory_enter_rt();
+            synth_process(&output->synth, buffer, render_frames);
+            if (output->tap)
+                tap_write(output->tap, buffer, render_frames);
+            audio_memory_leave_rt();
+            audio_stats_end(&output->stats, start, render_frames);
+            trace_end(output->synth.trace, "render_buffer");
+            SDL_QueueAudio(output->device, buffer, buffer_bytes);
+            started = true;
         }
         else
         {
-            buffer[i] = 0; // Silence when the note is not active
+            // Wake up about when one buffer has been consumed
+            SDL_Delay(period_ms > 1 ? period_ms / 2 : 1);
         }
     }
+
+    SDL_free(buffer);
+    return 0;
 }
 
-void render_text(SDL_Renderer *renderer, const char *text, int x, int y)
+// Called by every input source before it queues an event. Safe from any
+// thread except the audio thread.
+void wake_audio(void)
 {
-    // Placeholder rendering as a rectangle since SDL has no text rendering by default
-    SDL_Rect rect = {x, y, 100, 50};
-    SDL_SetRenderDrawColor(renderer, 200, 0, 0, 255);
-    SDL_RenderFillRect(renderer, &rect);
+    SDL_AtomicSet(&last_input, (int)SDL_GetTicks());
+    if (!pause_lock)
+        return;
+
+    SDL_LockMutex(pause_lock);
+    for (int i = 0; i < output_count; i++)
+        if (outputs[i].paused)
+        {
+            SDL_PauseAudioDevice(outputs[i].device, 0);
+            outputs[i].paused = false;
+        }
+    SDL_UnlockMutex(pause_lock);
+}
+
+// Main thread: pause each device after a stretch of silence on it. The input
+// time check keeps a stale idle flag from pausing right after a new note.
+void check_idle(void)
+{
+    Uint32 since_input = SDL_GetTicks() - (Uint32)SDL_AtomicGet(&last_input);
+
+    if (!pause_lock || since_input < idle_pause_ms)
+        return;
+
+    SDL_LockMutex(pause_lock);
+    for (int i = 0; i < output_count; i++)
+        if (!outputs[i].paused && SDL_AtomicGet(&outputs[i].synth.idle))
+        {
+            SDL_PauseAudioDevice(outputs[i].device, 1);
+            outputs[i].paused = true;
+        }
+    SDL_UnlockMutex(pause_lock);
+}
+
+// Hand a note event over to the audio thread
+void send_note(Uint8 type, int note)
+{
+    SynthEvent event;
+    SDL_zero(event);
+    event.time = SDL_GetPerformanceCounter();
+    event.type = type;
+    event.note = (Uint8)note;
+    event.value = 127; // Keys have no velocity, play them at full level
+
+    wake_audio();
+    if (!event_fanout_push(&note_targets, &event))
+        SDL_Log("Note event queue full, dropping event");
+}
+
+// Hand a reloaded patch over without stopping the device: changed values go
+// through the queue like notes and ramp in on the audio thread, a changed
+// graph is compiled here and swapped in whole once its reverbs are loaded.
+// A graph that does not parse or compile for every output is left out: the
+// values still apply and the graph playing stays, retried on the next save.
+void apply_patch(const Patch *next)
+{
+    for (int p = 0; p < PARAM_COUNT; p++)
+    {
+        Uint32 bit = 1u << p;
+        if (!(next->set & bit) || ((patch.set & bit) && patch.values[p] == next->values[p]))
+            continue;
+
+        SynthEvent event;
+        SDL_zero(event);
+        event.time = SDL_GetPerformanceCounter();
+        event.type = EVENT_PARAM;
+        event.note = (Uint8)p;
+        event.amount = next->values[p];
+
+        wake_audio();
+        if (!event_fanout_push(&note_targets, &event))
+            SDL_Log("Note event queue full, dropping patch parameter");
+    }
+
+    if (SDL_strcmp(patch.graph, next->graph) != 0)
+    {
+        GraphDesc desc;
+        GraphPlan *plans[MAX_OUTPUTS];
+        int compiled = 0;
+
+        // Each output runs its own copy, at its own rate and layout. All of
+        // them compile before any is built, no output switches alone.
+        graph_desc_init(&desc);
+        bool ok = next->graph[0] == '\0' || graph_parse(&desc, next->graph);
+        while (ok && compiled < output_count)
+        {
+            const Synth *synth = &outputs[compiled].synth;
+            plans[compiled] = graph_compile(&desc, synth->sample_rate, synth->channels);
+            ok = plans[compiled] != NULL;
+            compiled += ok;
+        }
+
+        if (ok)
+        {
+            wake_audio();
+            for (int i = 0; i < output_count; i++)
+                graph_build(&outputs[i].graph, plans[i]);
+        }
+        else
+        {
+            for (int i = 0; i < compiled; i++)
+                graph_plan_free(plans[i]);
+            SDL_Log("Patch graph not applied, the previous one keeps playing");
+
+            // Only the values are taken, so the next save compares against the old graph
+            SDL_memcpy(patch.values, next->values, sizeof(patch.values));
+            patch.set = next->set;
+            return;
+        }
+    }
+    patch = *next;
+}
+
+// Start, stop or retime the sequencer: the pattern goes over whole, the
+// device is woken for it like for a note
+void publish_pattern(void)
+{
+    wake_audio();
+    for (int i = 0; i < output_count; i++)
+        sequencer_publish(&outputs[i].sequencer, &pattern);
+}
+
+// Two-octave tracker layout: each row lists the keys of consecutive
+// semitones, starting on C at the given MIDI note
+typedef struct KeyRow
+{
+    const char *keys;
+    int first_note;
+} KeyRow;
+
+static const KeyRow keyboard_rows[] = {
+    {"zsxdcvgbhnjm,l.;/", 60}, // C4..E5, 'n' is A4
+    {"q2w3er5t6y7ui9o0p", 72}, // C5..E6
+};
+
+static const char *const pitch_names[12] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+
+// Keycode -> MIDI note, -1 if unmapped. SDL keycodes of printable keys are
+// their ASCII value, so the table is indexed directly.
+Sint8 key_notes[128];
+
+void init_keyboard(void)
+{
+    SDL_memset(key_notes, -1, sizeof(key_notes));
+    for (size_t r = 0; r < SDL_arraysize(keyboard_rows); r++)
+    {
+        const char *keys = keyboard_rows[r].keys;
+        for (int i = 0; keys[i]; i++)
+            key_notes[(Uint8)keys[i]] = (Sint8)(keyboard_rows[r].first_note + i);
+    }
+}
+
+// Map a key to a MIDI note number, -1 if unmapped
+int key_to_note(SDL_Keycode key)
+{
+    if (key < 0 || key >= (SDL_Keycode)SDL_arraysize(key_notes) || key_notes[key] < 0)
+        return -1;
+
+    return key_notes[key];
+}
+
+// Build the whole window as one batch: the held notes, the oscilloscope,
+// the spectrum, the channel meters and the output format, all from the
+// analyzer's latest window
+void draw_window(SDL_Renderer *renderer)
+{
+    static const SDL_Color ink = {40, 40, 40, 255};
+    static const SDL_Color trace = {20, 90, 200, 255};
+    static const SDL_Color panel = {235, 235, 235, 255};
+    static const SDL_Color axis = {200, 200, 200, 255};
+    static const SDL_Color level = {60, 170, 90, 255};
+    char label[128] = "";
+    size_t length = 0;
+
+    for (int n = 0; n < SYNTH_NOTES && length + 8 < sizeof(label); n++)
+        if (keys_down[n])
+            length += SDL_snprintf(label + length, sizeof(label) - length, "%s%s%d", length ? " " : "",
+                                   pitch_names[n % 12], n / 12 - 1);
+    if (length == 0)
+        SDL_strlcpy(label, "Z-M / Q-P TO PLAY", sizeof(label));
+
+    ui_begin(&ui);
+
+    int scale = ui_text_width(label, 3) <= WINDOW_WIDTH - 20 ? 3 : 2;
+    ui_text(&ui, (WINDOW_WIDTH - ui_text_width(label, scale)) / 2, 12, scale, label, ink);
+
+    SDL_FRect scope = {10, 48, WINDOW_WIDTH - 80, 120};
+    ui_rect(&ui, scope.x, scope.y, scope.w, scope.h, panel);
+    ui_rect(&ui, scope.x, scope.y + scope.h / 2, scope.w, 1, axis);
+    ui_scope(&ui, &scope, analyzer.mono, ANALYZER_SIZE, 1.0f, trace);
+
+    SDL_FRect spectrum = {10, 176, scope.w, 80};
+    ui_rect(&ui, spectrum.x, spectrum.y, spectrum.w, spectrum.h, panel);
+    ui_bars(&ui, &spectrum, analyzer.bands, ANALYZER_BANDS, 1, trace);
+
+    // RMS bars with a peak tick per channel
+    SDL_FRect meters = {WINDOW_WIDTH - 60, 48, 50, 208};
+    float width = (meters.w + 2) / analyzer.channels - 2;
+    ui_rect(&ui, meters.x, meters.y, meters.w, meters.h, panel);
+    ui_bars(&ui, &meters, analyzer.rms, analyzer.channels, 2, level);
+    for (int c = 0; c < analyzer.channels; c++)
+        if (analyzer.peak[c] > 0.0f)
+            ui_rect(&ui, meters.x + c * (width + 2), meters.y + (1.0f - analyzer.peak[c]) * meters.h, width, 2, ink);
+
+    ui_text(&ui, 10, WINDOW_HEIGHT - 28, 2, output_label, ink);
+    if (pattern.mode != SEQ_OFF)
+    {
+        static const char *const mode_names[] = {"", "SEQ", "UP", "DOWN", "UPDN"};
+        char status[32];
+        SDL_snprintf(status, sizeof(status), "%s %.0f BPM", mode_names[pattern.mode], pattern.tempo);
+        ui_text(&ui, WINDOW_WIDTH - 10 - ui_text_width(status, 2), WINDOW_HEIGHT - 28, 2, status, ink);
+    }
+
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_RenderClear(renderer);
+    ui_draw(&ui);
+    SDL_RenderPresent(renderer);
+}
+
+// Show the audio thread load in the window title, the busiest output's
+void update_title(SDL_Window *window)
+{
+    AudioStatsData stats;
+    double load = -1.0, peak = 0.0;
+    Uint64 xruns = 0;
+    char title[128];
+
+    for (int i = 0; i < output_count; i++)
+    {
+        audio_stats_snapshot(&outputs[i].stats, &stats);
+        if (stats.period_ticks == 0)
+            continue;
+        load = SDL_max(load, (double)stats.busy_ticks / stats.period_ticks);
+        peak = SDL_max(peak, (double)stats.max_load);
+        xruns += stats.deadline_misses + stats.late_callbacks;
+    }
+    if (load < 0.0)
+        return;
+
+    SDL_snprintf(title, sizeof(title), WINDOW_TITLE " - audio %.0f%% peak %.0f%% xruns %llu", 100.0 * load,
+                 100.0 * peak, (unsigned long long)xruns);
+    SDL_SetWindowTitle(window, title);
 }
 
 // Cleanup function to ensure all resources are freed
 void cleanup(SDL_Window *window, SDL_Renderer *renderer)
 {
+    midi_input_close();
+    osc_input_close();
+    SDL_AtomicSet(&render_running, 0);
+    for (int i = 0; i < output_count; i++)
+    {
+        Output *output = &outputs[i];
+        if (output->render_thread)
+        {
+            SDL_WaitThread(output->render_thread, NULL);
+            output->render_thread = NULL;
+            if (output->render_underruns > 0)
+                SDL_Log("Push mode: device queue ran dry %d times", output->render_underruns);
+        }
+    }
+    ui_close(&ui);
+    analyzer_close(&analyzer);
     if (renderer)
         SDL_DestroyRenderer(renderer);
     if (window)
         SDL_DestroyWindow(window);
-    if (audio_device)
-        SDL_CloseAudioDevice(audio_device);
+    if (pause_lock)
+    {
+        SDL_DestroyMutex(pause_lock);
+        pause_lock = NULL;
+    }
+    for (int i = 0; i < output_count; i++)
+    {
+        Output *output = &outputs[i];
+        if (output->device)
+        {
+            AudioStatsData stats;
+
+            SDL_CloseAudioDevice(output->device);
+            output->device = 0;
+            if (output_count > 1)
+                SDL_Log("Output %d, %s:", i + 1, output->name ? output->name : "default device");
+            audio_stats_snapshot(&output->stats, &stats);
+            audio_stats_log(&stats);
+        }
+        // Workers only run inside a render call, stop them once the device is closed
+        if (output->synth.pool)
+        {
+            int misses = SDL_AtomicGet(&output->pool->misses);
+            if (misses > 0)
+                SDL_Log("Render pool missed %d deadlines, rendering on the audio thread alone for %d blocks after each",
+                        misses, RENDER_BACKOFF_BLOCKS);
+            render_pool_stop(output->pool);
+            output->synth.pool = NULL;
+        }
+        if (output->synth.graph)
+        {
+            graph_close(&output->graph);
+            output->synth.graph = NULL;
+        }
+        output->synth.sampler = NULL;
+        output->pool = NULL;
+    }
+    output_count = 0;
+    // Every traced thread has stopped now
+    trace_close();
+    main_trace = NULL;
+    // Only once no device plays from it any more
+    sampler_close(&sampler);
+    audio_arena_free(&audio_arena);
     SDL_Quit();
 }
 
+void print_usage(const char *program)
+{
+    printf("usage: %s [options]\n"
+           "  --rate HZ        sample rate to request (default %d)\n"
+           "  --buffer FRAMES  device buffer size to request (default %d)\n"
+           "  --low-latency    request a 64-256 frame buffer (default %d)\n"
+           "  --queue [N]      push mode: render on a thread and keep N buffers queued (default %d)\n"
+           "  --render FILE    headless: render --script to a WAV file, no window or device\n"
+           "  --script FILE    note script for --render\n"
+           "  --compare GOLDEN [STEPS]  check the --render output against an earlier one, failing if\n"
+           "                   a sample differs by more than STEPS of 16 bits (default %d)\n"
+           "  --midi [PORT]    MIDI input, ALSA client:port or WinMM device index\n"
+           "  --osc [PORT]     OSC control over UDP: /note/on, /note/off, /cc and /param/NAME (default port %d)\n"
+           "  --idle-pause S   pause the device after S seconds of silence, 0 never (default %d)\n"
+           "  --dither         dither the output if the device is 16-bit\n"
+           "  --threads N      render voices on N worker threads as well, at most %d (default 0)\n"
+           "  --channels N     output channels to request, 1-%d, the device may pick others (default %d)\n"
+           "  --spread STEPS   pan notes apart by STEPS of 127 per semitone from middle C (default 0)\n"
+           "  --cutoff HZ      resonant low-pass on every voice (default off, MIDI CC 74 turns it on)\n"
+           "  --resonance R    filter resonance from 0 to 1 (default 0, MIDI CC 71)\n"
+           "  --filter-env OCT octaves the envelope opens the filter by (default 0)\n"
+           "  --sample FILE [ROOT]  play a WAV sample recorded at MIDI note ROOT (default %d), repeat\n"
+           "                   for a multisample, each note uses the nearest root\n"
+           "  --arp MODE       arpeggiate the held keys in sixteenths, MODE up, down or updown\n"
+           "  --pattern STEPS  step sequence such as \"0 3 7 . 12 -\": semitones from middle C, or\n"
+           "                   from the arpeggio note with --arp, '.' rests, '-' ties\n"
+           "  --tempo BPM      sequencer tempo (default %.0f), Space starts and stops, Up / Down change it\n"
+           "  --graph SPEC     run the voices through a DSP graph such as\n"
+           "                   \"lp = lowpass voices 800; hum = osc 55; g = gain hum 0.3; out = mix lp g\"\n"
+           "                   or \"echo = delay voices 0.3 0.4; room = reverb voices \\\"hall.wav\\\"; out = mix voices echo room\"\n"
+           "  --patch FILE     sound settings and graph from FILE, reloaded whenever it is saved\n"
+           "  --output DEVICE [LOW-HIGH]  play on DEVICE, \"default\" for the system one, only MIDI notes\n"
+           "                   LOW to HIGH if given; repeat for up to %d devices, each with its own engine\n"
+           "  --trace FILE     record callback, render stage, event and frame timings, written as a\n"
+           "                   Chrome trace for chrome://tracing or ui.perfetto.dev on exit\n",
+           program, SAMPLE_RATE, BUFFER_FRAMES, LOW_LATENCY_FRAMES, QUEUE_DEPTH, COMPARE_TOLERANCE, OSC_PORT, IDLE_PAUSE,
+           RENDER_POOL_MAX_WORKERS, SYNTH_MAX_CHANNELS, CHANNELS, SAMPLE_ROOT, TEMPO, MAX_OUTPUTS);
+}
+
+// Parse the command line into `options`, false on a bad argument
+bool parse_options(int argc, char *argv[], Options *options)
+{
+    options->sample_rate = SAMPLE_RATE;
+    options->buffer_frames = 0;
+    options->low_latency = false;
+    options->queue_depth = 0;
+    options->render_path = NULL;
+    options->script_path = NULL;
+    options->golden_path = NULL;
+    options->tolerance = COMPARE_TOLERANCE;
+    options->midi = false;
+    options->midi_port = NULL;
+    options->osc_port = 0;
+    options->idle_pause = IDLE_PAUSE;
+    options->dither = false;
+    options->threads = 0;
+    options->channels = CHANNELS;
+    options->spread = 0.0f;
+    options->cutoff = 0.0f;
+    options->resonance = 0.0f;
+    options->filter_env = 0.0f;
+    options->sample_count = 0;
+    options->sequencer_mode = SEQ_OFF;
+    options->pattern = NULL;
+    options->tempo = TEMPO;
+    options->graph = NULL;
+    options->patch = NULL;
+    options->trace_path = NULL;
+    options->output_count = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (SDL_strcmp(arg, "--rate") == 0 && has_value)
+            options->sample_rate = SDL_atoi(argv[++i]);
+        else if (SDL_strcmp(arg, "--buffer") == 0 && has_value)
+            options->buffer_frames = SDL_atoi(argv[++i]);
+        else if (SDL_strcmp(arg, "--low-latency") == 0)
+            options->low_latency = true;
+        else if (SDL_strcmp(arg, "--render") == 0 && has_value)
+            options->render_path = argv[++i];
+        else if (SDL_strcmp(arg, "--script") == 0 && has_value)
+            options->script_path = argv[++i];
+        else if (SDL_strcmp(arg, "--compare") == 0 && has_value)
+        {
+            options->golden_path = argv[++i];
+            if (i + 1 < argc && SDL_isdigit((unsigned char)argv[i + 1][0]))
+                options->tolerance = SDL_atoi(argv[++i]);
+        }
+        else if (SDL_strcmp(arg, "--channels") == 0 && has_value)
+            options->channels = SDL_atoi(argv[++i]);
+        else if (SDL_strcmp(arg, "--spread") == 0 && has_value)
+            options->spread = (float)SDL_atof(argv[++i]);
+        else if (SDL_strcmp(arg, "--cutoff") == 0 && has_value)
+            options->cutoff = (float)SDL_atof(argv[++i]);
+        else if (SDL_strcmp(arg, "--resonance") == 0 && has_value)
+            options->resonance = (float)SDL_atof(argv[++i]);
+        else if (SDL_strcmp(arg, "--filter-env") == 0 && has_value)
+            options->filter_env = (float)SDL_atof(argv[++i]);
+        else if (SDL_strcmp(arg, "--sample") == 0 && has_value)
+        {
+            if (options->sample_count == SAMPLER_MAX_SAMPLES)
+                return false;
+            options->sample_paths[options->sample_count] = argv[++i];
+            options->sample_roots[options->sample_count] = SAMPLE_ROOT;
+            if (i + 1 < argc && SDL_isdigit((unsigned char)argv[i + 1][0]))
+                options->sample_roots[options->sample_count] = SDL_atoi(argv[++i]);
+            options->sample_count++;
+        }
+        else if (SDL_strcmp(arg, "--arp") == 0 && has_value)
+        {
+            const char *mode = argv[++i];
+            if (SDL_strcmp(mode, "up") == 0)
+                options->sequencer_mode = SEQ_ARP_UP;
+            else if (SDL_strcmp(mode, "down") == 0)
+                options->sequencer_mode = SEQ_ARP_DOWN;
+            else if (SDL_strcmp(mode, "updown") == 0)
+                options->sequencer_mode = SEQ_ARP_UPDOWN;
+            else
+                return false;
+        }
+        else if (SDL_strcmp(arg, "--pattern") == 0 && has_value)
+            options->pattern = argv[++i];
+        else if (SDL_strcmp(arg, "--graph") == 0 && has_value)
+            options->graph = argv[++i];
+        else if (SDL_strcmp(arg, "--patch") == 0 && has_value)
+            options->patch = argv[++i];
+        else if (SDL_strcmp(arg, "--trace") == 0 && has_value)
+            options->trace_path = argv[++i];
+        else if (SDL_strcmp(arg, "--output") == 0 && has_value)
+        {
+            int low = 0, high = SYNTH_NOTES - 1;
+            if (options->output_count == MAX_OUTPUTS)
+                return false;
+            const char *device = argv[++i];
+            if (i + 1 < argc && SDL_isdigit((unsigned char)argv[i + 1][0]) &&
+                (SDL_sscanf(argv[++i], "%d-%d", &low, &high) != 2 || low < 0 || low > high || high >= SYNTH_NOTES))
+                return false;
+            options->output_devices[options->output_count] = SDL_strcmp(device, "default") == 0 ? NULL : device;
+            options->output_zones[options->output_count][0] = (Uint8)low;
+            options->output_zones[options->output_count][1] = (Uint8)high;
+            options->output_count++;
+        }
+        else if (SDL_strcmp(arg, "--tempo") == 0 && has_value)
+            options->tempo = (float)SDL_atof(argv[++i]);
+        else if (SDL_strcmp(arg, "--threads") == 0 && has_value)
+            options->threads = SDL_atoi(argv[++i]);
+        else if (SDL_strcmp(arg, "--dither") == 0)
+            options->dither = true;
+        else if (SDL_strcmp(arg, "--idle-pause") == 0 && has_value)
+            options->idle_pause = SDL_atoi(argv[++i]);
+        else if (SDL_strcmp(arg, "--midi") == 0)
+        {
+            options->midi = true;
+            if (has_value && argv[i + 1][0] != '-')
+                options->midi_port = argv[++i];
+        }
+        else if (SDL_strcmp(arg, "--osc") == 0)
+        {
+            options->osc_port = OSC_PORT;
+            if (has_value && argv[i + 1][0] != '-')
+                options->osc_port = SDL_atoi(argv[++i]);
+            if (options->osc_port <= 0 || options->osc_port > 65535)
+                return false;
+        }
+        else if (SDL_strcmp(arg, "--queue") == 0)
+        {
+            options->queue_depth = QUEUE_DEPTH;
+            if (has_value && argv[i + 1][0] != '-')
+                options->queue_depth = SDL_atoi(argv[++i]);
+            if (options->queue_depth < 2)
+                return false;
+        }
+        else
+            return false;
+    }
+
+    if ((options->render_path && !options->script_path) || (options->golden_path && !options->render_path))
+        return false;
+
+    if (options->buffer_frames == 0)
+        options->buffer_frames = options->low_latency ? LOW_LATENCY_FRAMES : BUFFER_FRAMES;
+    if (options->low_latency)
+        options->buffer_frames = SDL_clamp(options->buffer_frames, 64, 256);
+
+    if (options->pattern && options->sequencer_mode == SEQ_OFF)
+        options->sequencer_mode = SEQ_STEP;
+
+    // Without --output the default device plays everything
+    if (options->output_count == 0)
+    {
+        options->output_devices[0] = NULL;
+        options->output_zones[0][0] = 0;
+        options->output_zones[0][1] = SYNTH_NOTES - 1;
+        options->output_count = 1;
+    }
+
+    return options->sample_rate > 0 && options->buffer_frames > 0 && options->buffer_frames <= 65535 &&
+           options->threads >= 0 && options->threads <= RENDER_POOL_MAX_WORKERS && options->channels >= 1 &&
+           options->channels <= SYNTH_MAX_CHANNELS && options->tempo >= MIN_TEMPO && options->tempo <= MAX_TEMPO;
+}
+
+// Open device `index` of the options and set up the engine rendering for
+// it, the device is left paused. Every output registers its own queues and
+// shares the sampler, its voices stream from their own slice of it.
+bool open_output(Output *output, int index, const Options *options)
+{
+    SDL_AudioSpec desired_spec;
+    SDL_zero(desired_spec);
+    desired_spec.freq = options->sample_rate;
+    desired_spec.format = AUDIO_F32SYS; // The mix is float, skip conversion if the device is too
+    desired_spec.channels = (Uint8)options->channels;
+    desired_spec.samples = (Uint16)options->buffer_frames;
+    desired_spec.callback = options->queue_depth ? NULL : audio_callback; // NULL selects SDL_QueueAudio
+    desired_spec.userdata = output;
+    output->name = options->output_devices[index];
+
+    // Open audio device, the rate, channel count and buffer size may differ
+    // from what we asked for. Take Sint16 natively if that is what the device
+    // has, so the output stage can dither; any other format gets SDL's float
+    // conversion instead.
+    SDL_AudioSpec *obtained = &output->spec;
+    int allowed = SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE;
+    output->device = SDL_OpenAudioDevice(output->name, 0, &desired_spec, obtained, allowed | SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+    if (output->device && obtained->format != AUDIO_F32SYS && obtained->format != AUDIO_S16SYS)
+    {
+        SDL_CloseAudioDevice(output->device);
+        output->device = SDL_OpenAudioDevice(output->name, 0, &desired_spec, obtained, allowed);
+    }
+    if (!output->device)
+    {
+        SDL_Log("Error opening audio device %s: %s", output->name ? output->name : "(default)", SDL_GetError());
+        if (output->name)
+            for (int i = 0; i < SDL_GetNumAudioDevices(0); i++)
+                SDL_Log("  output device: %s", SDL_GetAudioDeviceName(i, 0));
+        return false;
+    }
+
+    // Render at whatever the device granted, the callback is not running yet
+    Synth *synth = &output->synth;
+    synth_init(synth, obtained->freq, AMPLITUDE);
+    if (!synth_set_output(synth, obtained->format, obtained->channels, options->dither))
+    {
+        SDL_Log("Unsupported audio output: %d channels", obtained->channels);
+        return false;
+    }
+    synth->pan_spread = options->spread;
+    synth_set_filter(synth, options->cutoff, options->resonance, options->filter_env);
+    char thread_name[32];
+    SDL_snprintf(thread_name, sizeof(thread_name), "%s %d", options->queue_depth ? "render" : "audio", index + 1);
+    synth->trace = trace_ring(thread_name);
+    synth->zone_low = options->output_zones[index][0];
+    synth->zone_high = options->output_zones[index][1];
+    for (int p = 0; p < PARAM_COUNT; p++)
+        if (patch.set & (1u << p))
+            synth_set_param(synth, p, patch.values[p]);
+    synth->output_gain = synth->output_target;
+    if (options->idle_pause > 0 && !options->queue_depth)
+        synth->idle_limit = (Uint64)options->idle_pause * obtained->freq;
+
+    if (options->threads > 0)
+    {
+        output->pool = audio_arena_alloc(&audio_arena, sizeof(RenderPool));
+        if (!output->pool || !render_pool_start(output->pool, options->threads, obtained->freq))
+            return false;
+        synth->pool = output->pool;
+    }
+    if (sampler.sample_count > 0)
+    {
+        synth->sampler = &sampler;
+        synth->stream_base = index * SYNTH_MAX_VOICES;
+    }
+
+    sequencer_init(&output->sequencer, obtained->freq);
+    synth->sequencer = &output->sequencer;
+    if (pattern.mode != SEQ_OFF)
+        sequencer_publish(&output->sequencer, &pattern);
+
+    // With a patch the graph is always there, voices alone until the patch has one
+    const char *graph_text = patch.graph[0] ? patch.graph : options->graph;
+    if (graph_text || options->patch)
+    {
+        GraphDesc desc;
+        graph_desc_init(&desc);
+        GraphPlan *plan = !graph_text || graph_parse(&desc, graph_text)
+                              ? graph_compile(&desc, obtained->freq, obtained->channels)
+                              : NULL;
+        if (!plan)
+            return false;
+        // Impulse responses load in the background, the voices play dry meanwhile
+        graph_init(&output->graph);
+        graph_build(&output->graph, plan);
+        synth->graph = &output->graph;
+    }
+
+    event_queue_init(&output->note_queue);
+    synth_attach_queue(synth, &output->note_queue);
+    event_queue_init(&output->midi_queue);
+    synth_attach_queue(synth, &output->midi_queue);
+    event_queue_init(&output->osc_queue);
+    synth_attach_queue(synth, &output->osc_queue);
+    audio_stats_init(&output->stats, obtained->freq);
+
+    // Events are placed relative to the previous callback, that costs one
+    // buffer on top of the one the device is playing
+    double buffer_ms = 1000.0 * obtained->samples / obtained->freq;
+    int buffered = options->queue_depth ? options->queue_depth : 1;
+    SDL_Log("Audio%s%s: %d Hz, %d channels, %s, %d frames per buffer (%.1f ms), key-to-sound latency about %.1f ms",
+            output->name ? " on " : "", output->name ? output->name : "", obtained->freq, synth->channels,
+            synth->format == AUDIO_F32SYS ? "float" : synth->dither ? "16-bit dithered" : "16-bit", obtained->samples, buffer_ms, (buffered + 1) * buffer_ms);
+    if (synth->zone_low > 0 || synth->zone_high < SYNTH_NOTES - 1)
+        SDL_Log("  plays MIDI notes %d to %d", synth->zone_low, synth->zone_high);
+    return true;
+}
+
 int main(int argc, char *argv[])
 {
+    Options options;
+    if (!parse_options(argc, argv, &options))
+    {
+        print_usage(argv[0]);
+        return -1;
+    }
+
+    // Before SDL allocates anything, debug builds only
+    audio_memory_install_trap();
+
+    // Headless mode needs neither video nor an audio device
+    if (options.render_path)
+    {
+        bool ok = offline_render(options.script_path, options.render_path, options.sample_rate, options.channels,
+                                 AMPLITUDE);
+        if (ok && options.golden_path)
+            ok = offline_compare(options.render_path, options.golden_path, options.tolerance);
+        return ok ? 0 : -1;
+    }
+
     if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO) < 0)
     {
         SDL_Log("Error initializing SDL: %s", SDL_GetError());
         return -1;
     }
+    if (options.trace_path)
+    {
+        if (!trace_open(options.trace_path))
+        {
+            SDL_Quit();
+            return -1;
+        }
+        main_trace = trace_ring("main");
+    }
 
-    // Audio specification setup
-    SDL_AudioSpec desired_spec;
-    SDL_zero(desired_spec);
-    desired_spec.freq = SAMPLE_RATE;
-    desired_spec.format = AUDIO_S16SYS;
-    desired_spec.channels = 1;
-    desired_spec.samples = 4096;
-    desired_spec.callback = audio_callback;
+    // Samples load before the devices open: small files are mapped and
+    // paged in now, large ones just read their header and head. Every output
+    // plays from the same copy.
+    sampler_init(&sampler);
+    for (int i = 0; i < options.sample_count; i++)
+    {
+        if (!sampler_load(&sampler, options.sample_paths[i], options.sample_roots[i]))
+        {
+            sampler_close(&sampler);
+            SDL_Quit();
+            return -1;
+        }
+    }
 
-    // Open audio device
-    audio_device = SDL_OpenAudioDevice(NULL, 0, &desired_spec, NULL, 0);
-    if (!audio_device)
+    // Audio-side memory, sized once for the whole session
+    if (!audio_arena_init(&audio_arena, AUDIO_ARENA_BYTES))
     {
-        SDL_Log("Error opening audio device: %s", SDL_GetError());
+        SDL_Log("Error allocating audio memory");
         SDL_Quit();
         return -1;
     }
 
+    // Space starts the --arp mode, the --pattern steps or else a plain
+    // arpeggio; either option starts it right away
+    sequencer_mode = options.sequencer_mode != SEQ_OFF ? options.sequencer_mode : SEQ_ARP_UP;
+    sequencer_pattern_init(&pattern, SEQ_OFF, options.tempo, 1);
+    if (options.pattern && !sequencer_pattern_parse(&pattern, options.pattern))
+    {
+        SDL_Log("Invalid --pattern steps: %s", options.pattern);
+        cleanup(NULL, NULL);
+        return -1;
+    }
+    if (options.sequencer_mode != SEQ_OFF)
+        pattern.mode = (Uint8)sequencer_mode;
+
+    // The patch overrides the options it sets, applied in place before the devices start
+    if (options.patch)
+    {
+        patch_watch_init(&patch_watch, options.patch);
+        if (!patch_poll(&patch_watch, &patch))
+        {
+            cleanup(NULL, NULL);
+            return -1;
+        }
+    }
+
+    event_fanout_init(&note_targets);
+    event_fanout_init(&midi_targets);
+    event_fanout_init(&osc_targets);
+    for (int i = 0; i < options.output_count; i++)
+    {
+        // Counted before it is set up, so cleanup() closes what did open
+        Output *output = &outputs[output_count++];
+        if (!open_output(output, i, &options))
+        {
+            cleanup(NULL, NULL);
+            return -1;
+        }
+        event_fanout_add(&note_targets, &output->note_queue);
+        event_fanout_add(&midi_targets, &output->midi_queue);
+        event_fanout_add(&osc_targets, &output->osc_queue);
+    }
+    if (sampler.sample_count > 0 && !sampler_start(&sampler, output_count))
+    {
+        cleanup(NULL, NULL);
+        return -1;
+    }
+
+    // The window shows the first output
+    Synth *first = &outputs[0].synth;
+    if (!tap_init(&output_tap, &audio_arena, first->frame_bytes, ANALYZER_SIZE, outputs[0].spec.samples) ||
+        !analyzer_init(&analyzer, first->sample_rate, first->format, first->channels))
+    {
+        SDL_Log("Out of memory for the output analyzer");
+        cleanup(NULL, NULL);
+        return -1;
+    }
+    outputs[0].tap = &output_tap;
+    int length = SDL_snprintf(output_label, sizeof(output_label), "%d HZ  %d CH  %s", first->sample_rate,
+                              first->channels, first->format == AUDIO_F32SYS ? "FLOAT" : "16 BIT");
+    if (output_count > 1)
+        SDL_snprintf(output_label + length, sizeof(output_label) - length, "  1 OF %d", output_count);
+
+    // Push mode keeps its own thread busy queueing, only pause the callback devices
+    if (options.idle_pause > 0 && !options.queue_depth)
+    {
+        idle_pause_ms = options.idle_pause * 1000;
+        pause_lock = SDL_CreateMutex();
+    }
+    init_keyboard();
+
+    if (options.queue_depth)
+    {
+        render_depth = options.queue_depth;
+        SDL_AtomicSet(&render_running, 1);
+        for (int i = 0; i < output_count; i++)
+        {
+            outputs[i].render_thread = SDL_CreateThread(render_thread_main, "synth render", &outputs[i]);
+            if (!outputs[i].render_thread)
+            {
+                SDL_Log("Error creating render thread: %s", SDL_GetError());
+                cleanup(NULL, NULL);
+                return -1;
+            }
+        }
+    }
+
+    // A missing MIDI device or a port in use is not fatal, the keyboard still plays
+    if (options.midi)
+        midi_input_open(&midi_targets, options.midi_port, wake_audio);
+    if (options.osc_port)
+        osc_input_open(&osc_targets, options.osc_port, first->sample_rate, wake_audio);
+
     // Start audio playback
-    SDL_PauseAudioDevice(audio_device, 0);
+    for (int i = 0; i < output_count; i++)
+        SDL_PauseAudioDevice(outputs[i].device, 0);
 
     // Create SDL window
-    SDL_Window *window = SDL_CreateWindow("(a-s-d-f keys) SDL Sinusoidal Synthesizer",
+    SDL_Window *window = SDL_CreateWindow(WINDOW_TITLE,
                                           SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
                                           WINDOW_WIDTH, WINDOW_HEIGHT,
                                           SDL_WINDOW_SHOWN);
@@ -108,68 +1010,118 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    // Vsync caps redraws to the display rate so a busy UI never spins the CPU
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
     if (!renderer)
     {
         SDL_Log("Error creating renderer: %s", SDL_GetError());
         cleanup(window, renderer);
         return -1;
     }
+    if (!ui_init(&ui, renderer))
+    {
+        SDL_Log("Error creating glyph atlas: %s", SDL_GetError());
+        cleanup(window, renderer);
+        return -1;
+    }
 
     bool running = true;
+    bool redraw = true;
     SDL_Event event;
+    Uint32 next_title = SDL_GetTicks() + TITLE_INTERVAL;
+    Uint32 next_patch = SDL_GetTicks() + PATCH_POLL_MS;
 
     while (running)
     {
-        while (SDL_PollEvent(&event))
+        // Sleep until there is input, the title is due or it is time to
+        // look at the output tap again instead of spinning, the audio thread
+        // gets the CPU to itself while nothing happens
+        Sint32 wait = (Sint32)(next_title - SDL_GetTicks());
+        wait = SDL_min(wait, analyzer.visible ? UI_POLL_MS : UI_IDLE_POLL_MS);
+        if (options.patch)
+            wait = SDL_min(wait, (Sint32)(next_patch - SDL_GetTicks()));
+        int have_event = SDL_WaitEventTimeout(&event, wait > 1 ? wait : 1);
+        trace_begin(main_trace, "frame");
+
+        while (have_event)
         {
             if (event.type == SDL_QUIT)
             {
                 running = false;
             }
-            else if (event.type == SDL_KEYDOWN)
+            else if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_SPACE && !event.key.repeat)
             {
-                switch (event.key.keysym.sym)
+                pattern.mode = (Uint8)(pattern.mode == SEQ_OFF ? sequencer_mode : SEQ_OFF);
+                publish_pattern();
+                redraw = true;
+            }
+            else if (event.type == SDL_KEYDOWN &&
+                     (event.key.keysym.sym == SDLK_UP || event.key.keysym.sym == SDLK_DOWN))
+            {
+                float change = event.key.keysym.sym == SDLK_UP ? TEMPO_STEP : -TEMPO_STEP;
+                pattern.tempo = SDL_min(SDL_max(pattern.tempo + change, MIN_TEMPO), MAX_TEMPO);
+                publish_pattern();
+                redraw = true;
+            }
+            else if (event.type == SDL_KEYDOWN && !event.key.repeat)
+            {
+                int note = key_to_note(event.key.keysym.sym);
+                if (note >= 0)
                 {
-                case SDLK_a:
-                    frequency = FREQUENCY_A4;
-                    note_name = "A";
-                    note_on = true;
-                    break;
-                case SDLK_s:
-                    frequency = FREQUENCY_A4 * pow(2, 1.0 / 12);
-                    note_name = "A#";
-                    note_on = true;
-                    break;
-                case SDLK_d:
-                    frequency = FREQUENCY_A4 * pow(2, 2.0 / 12);
-                    note_name = "B";
-                    note_on = true;
-                    break;
-                case SDLK_f:
-                    frequency = FREQUENCY_A4 * pow(2, 3.0 / 12);
-                    note_name = "C";
-                    note_on = true;
-                    break;
-                    // Add more notes as needed
+                    // A second key on a held note leaves it sounding
+                    if (keys_down[note]++ == 0)
+                        send_note(EVENT_NOTE_ON, note);
+                    redraw = true;
                 }
             }
             else if (event.type == SDL_KEYUP)
             {
-                note_on = false; // Stop the note when the key is released
+                int note = key_to_note(event.key.keysym.sym);
+                if (note >= 0 && keys_down[note] > 0)
+                {
+                    // Stop the note once the last key playing it is up
+                    if (--keys_down[note] == 0)
+                        send_note(EVENT_NOTE_OFF, note);
+                    redraw = true;
+                }
+            }
+            else if (event.type == SDL_WINDOWEVENT)
+            {
+                redraw = true; // Exposed, resized, restored...
             }
+
+            have_event = SDL_PollEvent(&event);
         }
 
-        // Rendering
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-        SDL_RenderClear(renderer);
+        // Rendering, only when something visible changed
+        if (analyzer_update(&analyzer, &output_tap))
+            redraw = true;
+        if (redraw)
+        {
+            trace_begin(main_trace, "draw");
+            draw_window(renderer);
+            trace_end(main_trace, "draw");
+            redraw = false;
+        }
 
-        if (note_on)
+        if (SDL_TICKS_PASSED(SDL_GetTicks(), next_title))
         {
-            render_text(renderer, note_name, 150, 120); // Show the note name
+            update_title(window);
+            next_title = SDL_GetTicks() + TITLE_INTERVAL;
+            check_idle();
         }
 
-        SDL_RenderPresent(renderer);
+        if (options.patch && SDL_TICKS_PASSED(SDL_GetTicks(), next_patch))
+        {
+            Patch next;
+            if (patch_poll(&patch_watch, &next))
+            {
+                apply_patch(&next);
+                SDL_Log("Reloaded patch %s", options.patch);
+            }
+            next_patch = SDL_GetTicks() + PATCH_POLL_MS;
+        }
+        trace_end(main_trace, "frame");
     }
 
     // Cleanup and exit
@@ -0,0 +1,704 @@
+#include "synth.h"
+
+#include <math.h>
+
+#include "graph.h"
+#include "render_pool.h"
+#include "sampler.h"
+#include "sequencer.h"
+#include "trace.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Equal-tempered frequencies of MIDI notes 0-127, A4 (69) = 440 Hz.
+// Generated, so the input path never calls pow().
+static const double note_frequencies[SYNTH_NOTES] = {
+    8.175799, 8.661957, 9.177024, 9.722718, 10.300861, 10.913382, 11.562326, 12.249857,
+    12.978272, 13.750000, 14.567618, 15.433853, 16.351598, 17.323914, 18.354048, 19.445436,
+    20.601722, 21.826764, 23.124651, 24.499715, 25.956544, 27.500000, 29.135235, 30.867706,
+    32.703196, 34.647829, 36.708096, 38.890873, 41.203445, 43.653529, 46.249303, 48.999429,
+    51.913087, 55.000000, 58.270470, 61.735413, 65.406391, 69.295658, 73.416192, 77.781746,
+    82.406889, 87.307058, 92.498606, 97.998859, 103.826174, 110.000000, 116.540940, 123.470825,
+    130.812783, 138.591315, 146.832384, 155.563492, 164.813778, 174.614116, 184.997211, 195.997718,
+    207.652349, 220.000000, 233.081881, 246.941651, 261.625565, 277.182631, 293.664768, 311.126984,
+    329.627557, 349.228231, 369.994423, 391.995436, 415.304698, 440.000000, 466.163762, 493.883301,
+    523.251131, 554.365262, 587.329536, 622.253967, 659.255114, 698.456463, 739.988845, 783.990872,
+    830.609395, 880.000000, 932.327523, 987.766603, 1046.502261, 1108.730524, 1174.659072, 1244.507935,
+    1318.510228, 1396.912926, 1479.977691, 1567.981744, 1661.218790, 1760.000000, 1864.655046, 1975.533205,
+    2093.004522, 2217.461048, 2349.318143, 2489.015870, 2637.020455, 2793.825851, 2959.955382, 3135.963488,
+    3322.437581, 3520.000000, 3729.310092, 3951.066410, 4186.009045, 4434.922096, 4698.636287, 4978.031740,
+    5274.040911, 5587.651703, 5919.910763, 6271.926976, 6644.875161, 7040.000000, 7458.620184, 7902.132820,
+    8372.018090, 8869.844191, 9397.272573, 9956.063479, 10548.081821, 11175.303406, 11839.821527, 12543.853951,
+};
+
+#define ENV_SILENCE 1e-4f   // -80 dB, released voices below this are retired
+#define ENV_LN_1000 6.9077553f // Decay and release times are to -60 dB
+
+#define FILTER_MIN_HZ 20.0f
+#define FILTER_MAX_RATIO 0.45f     // Highest cutoff as a fraction of the sample rate
+#define FILTER_MAX_RESONANCE 0.98f // Keeps some damping, short of self-oscillation
+#define FILTER_SMOOTHING 0.005f    // Seconds for the cutoff to settle after a change
+#define LEVEL_SMOOTHING 0.02f      // Seconds for the output level to settle after a change
+#define LEVEL_SETTLED 1e-5f
+
+// Every voice back on the free list, lowest index on top
+static void reset_voices(Synth *synth)
+{
+    synth->active_count = 0;
+    synth->free_count = SYNTH_MAX_VOICES;
+    for (int v = 0; v < SYNTH_MAX_VOICES; v++)
+        synth->free_voices[v] = (Uint8)(SYNTH_MAX_VOICES - 1 - v);
+}
+
+void synth_init(Synth *synth, int sample_rate, float amplitude)
+{
+    synth_kernels_init();
+
+    SDL_zerop(synth);
+    synth->kernels = synth_kernels_detect();
+    synth->sample_rate = sample_rate;
+    synth->output_gain = amplitude / 32768.0f;
+    synth->output_target = synth->output_gain;
+    synth_set_output(synth, AUDIO_S16SYS, 1, false);
+    synth->volume = 1.0f;
+    synth->pan = PAN_CENTER;
+    synth->zone_high = SYNTH_NOTES - 1;
+    reset_voices(synth);
+    synth->frames_per_tick = (double)sample_rate / SDL_GetPerformanceFrequency();
+    synth_set_envelope(synth, ENV_ATTACK, ENV_DECAY, ENV_SUSTAIN, ENV_RELEASE);
+
+    // Phase increments for every note at this sample rate, note on is a lookup
+    for (int n = 0; n < SYNTH_NOTES; n++)
+        synth->note_increment[n] = (Uint32)(note_frequencies[n] / sample_rate * 4294967296.0);
+}
+
+void synth_set_filter(Synth *synth, float cutoff, float resonance, float env_octaves)
+{
+    // Switching on starts from clean integrators at the new cutoff, not from
+    // whatever the voices last held
+    if (synth->filter_cutoff <= 0.0f && cutoff > 0.0f)
+    {
+        SDL_memset(synth->filter_ic1, 0, sizeof(synth->filter_ic1));
+        SDL_memset(synth->filter_ic2, 0, sizeof(synth->filter_ic2));
+        synth->filter_smoothed = SDL_max(cutoff, FILTER_MIN_HZ);
+    }
+    synth->filter_cutoff = cutoff > 0.0f ? SDL_max(cutoff, FILTER_MIN_HZ) : 0.0f;
+    synth->filter_resonance = SDL_clamp(resonance, 0.0f, 1.0f);
+    synth->filter_env = env_octaves;
+}
+
+// Per-frame slope of a segment lasting `seconds`, or its exponent with
+// `scale` ENV_LN_1000; each block turns them into one ramp
+static float segment_rate(const Synth *synth, float seconds, float scale)
+{
+    return seconds > 0.0f ? scale / (seconds * synth->sample_rate) : 1.0f;
+}
+
+void synth_set_envelope(Synth *synth, float attack, float decay, float sustain, float release)
+{
+    synth->attack_rate = segment_rate(synth, attack, 1.0f);
+    synth->decay_rate = segment_rate(synth, decay, ENV_LN_1000);
+    synth->release_rate = segment_rate(synth, release, ENV_LN_1000);
+    synth->sustain_level = SDL_clamp(sustain, 0.0f, 1.0f);
+}
+
+int synth_find_param(const char *name)
+{
+    static const char *const names[PARAM_COUNT] = {"level",  "attack",    "decay",      "sustain", "release",
+                                                   "cutoff", "resonance", "filter_env", "spread"};
+
+    for (int p = 0; p < PARAM_COUNT; p++)
+        if (SDL_strcmp(name, names[p]) == 0)
+            return p;
+    return -1;
+}
+
+void synth_set_param(Synth *synth, int param, float value)
+{
+    switch (param)
+    {
+    case PARAM_LEVEL:
+        synth->output_target = SDL_clamp(value, 0.0f, 1.0f);
+        break;
+    case PARAM_ATTACK:
+        synth->attack_rate = segment_rate(synth, value, 1.0f);
+        break;
+    case PARAM_DECAY:
+        synth->decay_rate = segment_rate(synth, value, ENV_LN_1000);
+        break;
+    case PARAM_SUSTAIN:
+        synth->sustain_level = SDL_clamp(value, 0.0f, 1.0f);
+        break;
+    case PARAM_RELEASE:
+        synth->release_rate = segment_rate(synth, value, ENV_LN_1000);
+        break;
+    case PARAM_CUTOFF:
+        synth_set_filter(synth, value, synth->filter_resonance, synth->filter_env);
+        break;
+    case PARAM_RESONANCE:
+        synth_set_filter(synth, synth->filter_cutoff, value, synth->filter_env);
+        break;
+    case PARAM_FILTER_ENV:
+        synth_set_filter(synth, synth->filter_cutoff, synth->filter_resonance, value);
+        break;
+    case PARAM_SPREAD:
+        synth->pan_spread = value;
+        break;
+    }
+}
+
+bool synth_set_output(Synth *synth, SDL_AudioFormat format, int channels, bool dither)
+{
+    if ((format != AUDIO_F32SYS && format != AUDIO_S16SYS) || channels < 1 || channels > SYNTH_MAX_CHANNELS)
+        return false;
+
+    synth->format = format;
+    synth->channels = channels;
+    synth->frame_bytes = SDL_AUDIO_BITSIZE(format) / 8 * channels;
+    synth->dither = dither && format == AUDIO_S16SYS;
+    // Distinct nonzero seeds, xorshift never leaves zero
+    for (int i = 0; i < SYNTH_DITHER_LANES; i++)
+        synth->dither_state[i] = 0x9E3779B9u * (Uint32)(i + 1);
+
+    // Panning matrix: position 0 is the first speaker, PAN_CENTER the middle
+    // of the row and 127 the last, each between two adjacent speakers
+    SDL_zero(synth->pan_table);
+    for (int p = 0; p < SYNTH_PAN_STEPS; p++)
+    {
+        float position = p <= PAN_CENTER ? 0.5f * p / PAN_CENTER
+                                         : 0.5f + 0.5f * (p - PAN_CENTER) / (SYNTH_PAN_STEPS - 1 - PAN_CENTER);
+        float x = position * (channels - 1);
+        int left = SDL_min((int)x, channels - 1);
+        float f = x - left;
+
+        synth->pan_table[p][left] = cosf(f * 0.5f * (float)M_PI);
+        if (left + 1 < channels)
+            synth->pan_table[p][left + 1] = sinf(f * 0.5f * (float)M_PI);
+    }
+    return true;
+}
+
+double synth_note_frequency(int note)
+{
+    return note_frequencies[note & (SYNTH_NOTES - 1)];
+}
+
+bool synth_attach_queue(Synth *synth, EventQueue *queue)
+{
+    if (synth->queue_count == SYNTH_MAX_QUEUES)
+        return false;
+    synth->queues[synth->queue_count++] = queue;
+    return true;
+}
+
+// Return voices marked free to the free list
+static void retire_voices(Synth *synth)
+{
+    for (int a = 0; a < synth->active_count;)
+    {
+        int v = synth->active[a];
+        if (synth->state[v] == VOICE_FREE)
+        {
+            if (synth->sample[v])
+            {
+                sampler_voice_stop(synth->sampler, synth->stream_base + v);
+                synth->sample[v] = NULL;
+            }
+            synth->free_voices[synth->free_count++] = (Uint8)v;
+            synth->active[a] = synth->active[--synth->active_count];
+        }
+        else
+            a++;
+    }
+}
+
+// Pick a voice for a new note: a free one if there is any, otherwise steal
+// the quietest released voice, or failing that the one held the longest
+static int find_voice(Synth *synth)
+{
+    if (synth->free_count > 0)
+    {
+        int v = synth->free_voices[--synth->free_count];
+        synth->active[synth->active_count++] = (Uint8)v;
+        return v;
+    }
+
+    int quietest = -1, oldest = synth->active[0];
+    for (int a = 0; a < synth->active_count; a++)
+    {
+        int v = synth->active[a];
+        if (synth->state[v] == VOICE_RELEASE && (quietest < 0 || synth->level[v] < synth->level[quietest]))
+            quietest = v;
+        if ((Sint32)(synth->started[v] - synth->started[oldest]) < 0)
+            oldest = v;
+    }
+    return quietest >= 0 ? quietest : oldest;
+}
+
+void synth_note_on(Synth *synth, int note, int velocity)
+{
+    int v = find_voice(synth);
+    note &= SYNTH_NOTES - 1;
+    synth->phase[v] = 0;
+    synth->increment[v] = synth->note_increment[note];
+    synth->gain[v] = SYNTH_VOICE_GAIN * velocity / 127.0f;
+    synth->level[v] = 0.0f;
+    synth->state[v] = VOICE_ATTACK;
+    synth->sustained[v] = false;
+    synth->note[v] = (Uint8)note;
+    synth->started[v] = synth->voice_clock++;
+    synth->filter_ic1[v] = 0.0f;
+    synth->filter_ic2[v] = 0.0f;
+
+    // With samples loaded every note plays the nearest one, repitched
+    synth->sample[v] = synth->sampler ? sampler_pick(synth->sampler, note) : NULL;
+    if (synth->sample[v])
+    {
+        const SampleData *sample = synth->sample[v];
+        double ratio = note_frequencies[note] / note_frequencies[sample->root & (SYNTH_NOTES - 1)];
+        synth->sample_pos[v] = 0;
+        synth->sample_step[v] = (Uint64)(ratio * sample->sample_rate / synth->sample_rate * 4294967296.0);
+        sampler_voice_start(synth->sampler, synth->stream_base + v, sample);
+    }
+}
+
+static void release_voice(Synth *synth, int v)
+{
+    synth->state[v] = VOICE_RELEASE;
+    synth->sustained[v] = false;
+}
+
+void synth_note_off(Synth *synth, int note)
+{
+    for (int a = 0; a < synth->active_count; a++)
+    {
+        int v = synth->active[a];
+        if (synth->state[v] == VOICE_RELEASE || synth->sustained[v] || synth->note[v] != note)
+            continue;
+        if (synth->sustain)
+            synth->sustained[v] = true;
+        else
+            release_voice(synth, v);
+    }
+}
+
+void synth_control(Synth *synth, int control, int value)
+{
+    switch (control)
+    {
+    case CC_VOLUME:
+        synth->volume = value / 127.0f;
+        break;
+    case CC_PAN:
+        synth->pan = (Uint8)value;
+        break;
+    case CC_CUTOFF:
+        // 20 Hz to 20 kHz, even steps in pitch
+        synth_set_filter(synth, FILTER_MIN_HZ * powf(1000.0f, value / 127.0f), synth->filter_resonance,
+                         synth->filter_env);
+        break;
+    case CC_RESONANCE:
+        synth->filter_resonance = value / 127.0f;
+        break;
+    case CC_SUSTAIN:
+        synth->sustain = value >= 64;
+        if (!synth->sustain)
+        {
+            for (int a = 0; a < synth->active_count; a++)
+            {
+                if (synth->sustained[synth->active[a]])
+                    release_voice(synth, synth->active[a]);
+            }
+        }
+        break;
+    case CC_ALL_NOTES_OFF:
+        for (int a = 0; a < synth->active_count; a++)
+            release_voice(synth, synth->active[a]);
+        break;
+    case CC_ALL_SOUND_OFF:
+        for (int a = 0; a < synth->active_count; a++)
+            synth->state[synth->active[a]] = VOICE_FREE;
+        retire_voices(synth);
+        break;
+    }
+}
+
+void synth_apply_event(Synth *synth, const SynthEvent *event)
+{
+    switch (event->type)
+    {
+    case EVENT_NOTE_ON:
+        // MIDI sends note on with velocity 0 for note off
+        if (event->value == 0)
+            synth_note_off(synth, event->note);
+        else
+            synth_note_on(synth, event->note, event->value);
+        break;
+    case EVENT_NOTE_OFF:
+        synth_note_off(synth, event->note);
+        break;
+    case EVENT_CONTROL:
+        synth_control(synth, event->note, event->value);
+        break;
+    case EVENT_PARAM:
+        synth_set_param(synth, event->note, event->amount);
+        break;
+    }
+}
+
+int synth_active_voices(const Synth *synth)
+{
+    return synth->active_count;
+}
+
+// Filter coefficients of voice `v` for the coming block, the smoothed
+// cutoff opened up by the envelope level it reaches
+static void update_filter(Synth *synth, int v, float level, float damping)
+{
+    float rate = (float)synth->sample_rate;
+    float cutoff = SDL_min(synth->filter_smoothed * exp2f(synth->filter_env * level), FILTER_MAX_RATIO * rate);
+    float g = tanf((float)M_PI * cutoff / rate);
+    float a1 = 1.0f / (1.0f + g * (g + damping));
+
+    synth->filter_a1[v] = a1;
+    synth->filter_a2[v] = g * a1;
+    synth->filter_a3[v] = g * g * a1;
+}
+
+void synth_update_envelopes(Synth *synth, int frames)
+{
+    // One exponent per segment for the whole block, not per voice or sample
+    float decay = expf(-synth->decay_rate * frames);
+    float release = expf(-synth->release_rate * frames);
+    float attack = synth->attack_rate * frames;
+    float sustain = synth->sustain_level;
+
+    bool filtered = synth->filter_cutoff > 0.0f;
+    float damping = 2.0f - 2.0f * FILTER_MAX_RESONANCE * synth->filter_resonance;
+    if (filtered)
+        synth->filter_smoothed += (synth->filter_cutoff - synth->filter_smoothed) *
+                                  (1.0f - expf(-frames / (FILTER_SMOOTHING * synth->sample_rate)));
+
+    for (int a = 0; a < synth->active_count; a++)
+    {
+        int v = synth->active[a];
+        float start = synth->level[v];
+        float end = start;
+
+        switch (synth->state[v])
+        {
+        case VOICE_ATTACK:
+            end = start + attack;
+            if (end >= 1.0f)
+            {
+                end = 1.0f;
+                synth->state[v] = VOICE_DECAY;
+            }
+            break;
+        case VOICE_DECAY:
+            end = sustain + (start - sustain) * decay;
+            break;
+        case VOICE_RELEASE:
+            end = start * release;
+            if (end < ENV_SILENCE)
+            {
+                end = 0.0f;
+                synth->state[v] = VOICE_FREE; // Retired once this block is rendered
+            }
+            break;
+        }
+
+        synth->level[v] = end;
+        synth->ramp_gain[v] = synth->gain[v] * start;
+        synth->ramp_step[v] = synth->gain[v] * (end - start) / frames;
+        if (filtered)
+            update_filter(synth, v, end, damping);
+    }
+}
+
+// Pan position of a voice for this block, moves with the pan controller
+static int voice_pan(const Synth *synth, int v)
+{
+    int position = synth->pan + (int)(synth->pan_spread * (synth->note[v] - 60));
+    return SDL_clamp(position, 0, SYNTH_PAN_STEPS - 1);
+}
+
+// Add one block of voice `v`'s oscillator or sample to `dest`
+static void render_source(Synth *synth, int v, float *dest, int frames)
+{
+    const SampleData *sample = synth->sample[v];
+
+    if (sample)
+    {
+        synth->sample_pos[v] = sampler_render_voice(synth->sampler, synth->stream_base + v, sample, dest,
+                                                    synth->sample_pos[v], synth->sample_step[v], synth->ramp_gain[v],
+                                                    synth->ramp_step[v], frames);
+        if ((synth->sample_pos[v] >> 32) >= sample->frames)
+            synth->state[v] = VOICE_FREE; // Played out, retired after this block
+    }
+    else
+    {
+        synth->phase[v] = synth->kernels->render_voice(dest, synth->phase[v], synth->increment[v],
+                                                       synth->ramp_gain[v], synth->ramp_step[v], frames);
+    }
+}
+
+static void pan_voice(Synth *synth, int v, float *bus, const float *voice, int frames)
+{
+    const float *pan = synth->pan_table[voice_pan(synth, v)];
+
+    for (int c = 0; c < synth->channels; c++)
+    {
+        if (pan[c] != 0.0f)
+            synth->kernels->accumulate(bus + c * SYNTH_BLOCK_SIZE, voice, pan[c], frames);
+    }
+}
+
+// Voices in groups of SYNTH_FILTER_LANES, each rendered into its own lane
+// of `scratch`, filtered together and then panned. A short last group runs
+// with silent lanes.
+static void render_filtered(Synth *synth, int first, int last, float *bus, float *scratch, int frames)
+{
+    const int lanes = SYNTH_FILTER_LANES;
+
+    for (int a = first; a < last; a += lanes)
+    {
+        int count = SDL_min(last - a, lanes);
+        float coefficients[3 * SYNTH_FILTER_LANES] = {0};
+        float state[2 * SYNTH_FILTER_LANES] = {0};
+
+        for (int l = 0; l < lanes; l++)
+        {
+            SDL_memset(scratch + l * SYNTH_BLOCK_SIZE, 0, frames * sizeof(float));
+            if (l >= count)
+                continue;
+
+            int v = synth->active[a + l];
+            render_source(synth, v, scratch + l * SYNTH_BLOCK_SIZE, frames);
+            coefficients[l] = synth->filter_a1[v];
+            coefficients[lanes + l] = synth->filter_a2[v];
+            coefficients[2 * lanes + l] = synth->filter_a3[v];
+            state[l] = synth->filter_ic1[v];
+            state[lanes + l] = synth->filter_ic2[v];
+        }
+
+        synth->kernels->filter_voices(scratch, SYNTH_BLOCK_SIZE, coefficients, state, frames);
+
+        for (int l = 0; l < count; l++)
+        {
+            int v = synth->active[a + l];
+            synth->filter_ic1[v] = state[l];
+            synth->filter_ic2[v] = state[lanes + l];
+            pan_voice(synth, v, bus, scratch + l * SYNTH_BLOCK_SIZE, frames);
+        }
+    }
+}
+
+void synth_render_voices(Synth *synth, int first, int last, float *bus, float *scratch, int frames)
+{
+    if (synth->filter_cutoff > 0.0f)
+    {
+        render_filtered(synth, first, last, bus, scratch, frames);
+        return;
+    }
+
+    for (int a = first; a < last; a++)
+    {
+        int v = synth->active[a];
+
+        // Mono needs no panning, mix straight into the bus
+        if (synth->channels == 1)
+        {
+            render_source(synth, v, bus, frames);
+            continue;
+        }
+        SDL_memset(scratch, 0, frames * sizeof(float));
+        render_source(synth, v, scratch, frames);
+        pan_voice(synth, v, bus, scratch, frames);
+    }
+}
+
+// Scale the planar bus by a gain going linearly from `start` to `end`
+static void ramp_bus(float *bus, int channels, float start, float end, int frames)
+{
+    float step = (end - start) / frames;
+
+    for (int c = 0; c < channels; c++)
+    {
+        float *samples = bus + c * SYNTH_BLOCK_SIZE;
+        for (int i = 0; i < frames; i++)
+            samples[i] *= start + step * i;
+    }
+}
+
+void synth_render(Synth *synth, void *out, int frames)
+{
+    Uint8 *dest = out;
+
+    if (synth->graph)
+        graph_update(synth->graph);
+
+    // Nothing sounding, skip the whole render path
+    if (synth->active_count == 0 && !(synth->graph && graph_busy(synth->graph)))
+    {
+        SDL_memset(out, 0, frames * synth->frame_bytes);
+        return;
+    }
+
+    while (frames > 0)
+    {
+        int block = frames < SYNTH_BLOCK_SIZE ? frames : SYNTH_BLOCK_SIZE;
+        float *mix = synth->mix;
+
+        for (int c = 0; c < synth->channels; c++)
+            SDL_memset(mix + c * SYNTH_BLOCK_SIZE, 0, block * sizeof(float));
+        trace_begin(synth->trace, "voices");
+        synth_update_envelopes(synth, block);
+        if (synth->active_count > RENDER_GROUP_VOICES && render_pool_usable(synth->pool))
+            render_pool_render(synth->pool, synth, mix, block);
+        else
+            synth_render_voices(synth, 0, synth->active_count, mix, synth->voice_buffer, block);
+        retire_voices(synth);
+        trace_end(synth->trace, "voices");
+        if (synth->graph)
+        {
+            trace_begin(synth->trace, "graph");
+            graph_process(synth->graph, synth, mix, block);
+            trace_end(synth->trace, "graph");
+        }
+
+        // A level change ramps over the block on the bus, the output stage
+        // then only applies the volume
+        float gain = synth->output_gain * synth->volume;
+        if (synth->output_gain != synth->output_target)
+        {
+            float start = synth->output_gain;
+            float end = start + (synth->output_target - start) *
+                                    (1.0f - expf(-block / (LEVEL_SMOOTHING * synth->sample_rate)));
+            if (fabsf(synth->output_target - end) < LEVEL_SETTLED)
+                end = synth->output_target;
+            ramp_bus(mix, synth->channels, start, end, block);
+            synth->output_gain = end;
+            gain = synth->volume;
+        }
+
+        // The only conversion of the whole path, everything above is float
+        trace_begin(synth->trace, "output");
+        if (synth->format == AUDIO_F32SYS)
+            synth->kernels->output_f32((float *)dest, mix, SYNTH_BLOCK_SIZE, synth->channels, gain, block);
+        else
+            synth->kernels->output_s16((Sint16 *)dest, mix, SYNTH_BLOCK_SIZE, synth->channels, gain,
+                                       synth->dither ? synth->dither_state : NULL, block);
+        trace_end(synth->trace, "output");
+
+        dest += block * synth->frame_bytes;
+        frames -= block;
+    }
+}
+
+// Oldest pending event over all queues that happened before `now`, NULL if none
+static const SynthEvent *next_event(Synth *synth, Uint64 now, EventQueue **from)
+{
+    const SynthEvent *best = NULL;
+
+    for (int q = 0; q < synth->queue_count; q++)
+    {
+        const SynthEvent *event = event_queue_peek(synth->queues[q]);
+        if (event && event->time <= now && (!best || event->time < best->time))
+        {
+            best = event;
+            *from = synth->queues[q];
+        }
+    }
+    return best;
+}
+
+// Render frames `from` to `to` of `out`, stopping at each sequencer step or
+// note off on the way so it plays at its exact frame
+static void render_span(Synth *synth, Uint8 *out, int from, int to)
+{
+    Sequencer *sequencer = synth->sequencer;
+
+    if (!sequencer)
+    {
+        synth_render(synth, out + from * synth->frame_bytes, to - from);
+        return;
+    }
+
+    for (;;)
+    {
+        int run = sequencer_next(sequencer, to - from);
+        if (run > 0)
+            synth_render(synth, out + from * synth->frame_bytes, run);
+        sequencer_advance(sequencer, synth, run);
+        from += run;
+        if (from >= to)
+            break;
+    }
+}
+
+// Notes outside the zone belong to another output, everything else is ours
+static bool in_zone(const Synth *synth, const SynthEvent *event)
+{
+    if (event->type != EVENT_NOTE_ON && event->type != EVENT_NOTE_OFF)
+        return true;
+    return event->note >= synth->zone_low && event->note <= synth->zone_high;
+}
+
+void synth_process(Synth *synth, void *out, int frames)
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 period_start = synth->last_process_time;
+    Uint64 period = (Uint64)(frames / synth->frames_per_tick);
+    const SynthEvent *event;
+    EventQueue *queue = NULL;
+    int pos = 0;
+
+    // After a pause or a stall, place events against one period back
+    if (now - period_start > 2 * period)
+        period_start = now - period;
+
+    if (synth->sequencer)
+        sequencer_update(synth->sequencer, synth);
+
+    event = next_event(synth, now, &queue);
+    if (!event && synth->active_count == 0 && !(synth->sequencer && sequencer_busy(synth->sequencer)) &&
+        !(synth->graph && graph_busy(synth->graph)))
+    {
+        SDL_memset(out, 0, frames * synth->frame_bytes);
+        synth->last_process_time = now;
+        synth->idle_frames += frames;
+        if (synth->idle_limit && synth->idle_frames >= synth->idle_limit)
+            SDL_AtomicSet(&synth->idle, 1);
+        return;
+    }
+    synth->idle_frames = 0;
+    SDL_AtomicSet(&synth->idle, 0);
+
+    // Events stamped after `now` belong to the next buffer
+    for (; event; event = next_event(synth, now, &queue))
+    {
+        int offset = 0;
+        if (event->time > period_start)
+            offset = (int)((event->time - period_start) * synth->frames_per_tick);
+        if (offset >= frames)
+            offset = frames - 1;
+
+        // Events come out in time order, never render backwards
+        if (offset > pos)
+        {
+            render_span(synth, out, pos, offset);
+            pos = offset;
+        }
+        trace_begin(synth->trace, "event");
+        if (in_zone(synth, event) && (!synth->sequencer || !sequencer_take_event(synth->sequencer, event)))
+            synth_apply_event(synth, event);
+        event_queue_pop(queue);
+        trace_end(synth->trace, "event");
+    }
+
+    render_span(synth, out, pos, frames);
+    synth->last_process_time = now;
+}
@@ -0,0 +1,220 @@
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <SDL.h>
+#include <stdbool.h>
+
+#include "event_queue.h"
+#include "synth_kernels.h"
+
+#define SYNTH_MAX_VOICES 64  // Fixed voice pool, nothing is allocated while playing
+#define SYNTH_BLOCK_SIZE 256 // Frames mixed per pass of the render loop
+#define SYNTH_VOICE_GAIN 0.25f // Per-voice peak, leaves headroom for four-note chords
+#define NOTE_A4 69             // MIDI note number of A4, tuned to 440 Hz
+#define SYNTH_NOTES 128        // MIDI note range
+#define SYNTH_MAX_QUEUES 4     // Event sources, one SPSC queue per producer thread
+#define SYNTH_PAN_STEPS 128    // Pan positions, the MIDI controller range
+#define PAN_CENTER 64
+
+// Default envelope, times in seconds (decay and release to -60 dB)
+#define ENV_ATTACK 0.005f
+#define ENV_DECAY 0.3f
+#define ENV_SUSTAIN 0.7f
+#define ENV_RELEASE 0.25f
+
+// MIDI controllers the synth responds to
+#define CC_VOLUME 7
+#define CC_PAN 10
+#define CC_SUSTAIN 64
+#define CC_RESONANCE 71
+#define CC_CUTOFF 74
+#define CC_ALL_SOUND_OFF 120
+#define CC_ALL_NOTES_OFF 123
+
+// Patch parameters, set by synth_set_param() or an EVENT_PARAM
+enum
+{
+    PARAM_LEVEL = 0, // Output peak for a full mix, 0..1 of full scale
+    PARAM_ATTACK,    // Envelope times in seconds, sustain as a level in 0..1
+    PARAM_DECAY,
+    PARAM_SUSTAIN,
+    PARAM_RELEASE,
+    PARAM_CUTOFF, // Voice filter, see synth_set_filter()
+    PARAM_RESONANCE,
+    PARAM_FILTER_ENV,
+    PARAM_SPREAD, // Pan steps per semitone, see Synth.pan_spread
+    PARAM_COUNT
+};
+
+// Voice envelope states. Attack is a linear ramp, decay falls exponentially
+// towards the sustain level and release exponentially towards silence.
+enum
+{
+    VOICE_FREE = 0,
+    VOICE_ATTACK,
+    VOICE_DECAY, // Decay, then sustain once the level settles
+    VOICE_RELEASE
+};
+
+struct RenderPool;
+struct Sampler;
+struct SampleData;
+struct Sequencer;
+struct Graph;
+struct TraceRing;
+
+// Synth engine state. The voice pool is laid out as struct-of-arrays so the
+// render loop walks each field contiguously.
+typedef struct Synth
+{
+    int sample_rate;
+    const SynthKernels *kernels;
+    struct RenderPool *pool; // Parallel voice rendering, NULL renders on the calling thread
+    struct Sampler *sampler; // Sample playback, NULL plays sines
+    int stream_base; // First stream of our voices in a sampler shared with other synths
+    struct Sequencer *sequencer; // Step sequencer and arpeggiator, NULL for none
+    struct Graph *graph; // DSP graph between the mix bus and the output stage, NULL for none
+    struct TraceRing *trace; // Stage timings of the rendering thread, NULL while tracing is off
+    float output_gain; // Scale from the mix bus to full scale output
+    float output_target; // output_gain ramps here block by block after a level change
+    SDL_AudioFormat format; // AUDIO_F32SYS or AUDIO_S16SYS, see synth_set_output()
+    int channels;
+    int frame_bytes;
+    bool dither; // TPDF dither on Sint16 output
+    Uint32 dither_state[SYNTH_DITHER_LANES];
+    Uint32 voice_clock; // Bumped on every note on, used to find the oldest voice
+    Uint64 last_process_time; // Start of the previous synth_process() call
+    double frames_per_tick; // Sample frames per performance counter tick
+    float volume; // MIDI channel volume, 0..1
+    bool sustain; // Sustain pedal down
+    Uint8 pan;    // MIDI channel pan, PAN_CENTER is the middle of the layout
+    float pan_spread; // Pan offset per semitone from middle C, spreads chords across the speakers
+    Uint8 zone_low;  // Notes outside zone_low..zone_high are left to other synths
+    Uint8 zone_high;
+
+    // Envelope segments as per-frame rates, see synth_set_envelope()
+    float attack_rate;
+    float decay_rate;
+    float release_rate;
+    float sustain_level;
+
+    // Per-voice resonant low-pass, bypassed while filter_cutoff is 0, see
+    // synth_set_filter()
+    float filter_cutoff;    // Hz
+    float filter_resonance; // 0..1
+    float filter_env;       // Octaves the voice envelope opens the cutoff by at full level
+    float filter_smoothed;  // filter_cutoff followed block by block, so controller moves do not step
+
+    EventQueue *queues[SYNTH_MAX_QUEUES];
+    int queue_count;
+
+    // Idle detection for auto-pause: after idle_limit frames with no voice
+    // and no event the audio thread sets `idle` for the main thread to see
+    Uint64 idle_frames;
+    Uint64 idle_limit; // 0 disables
+    SDL_atomic_t idle;
+
+    Uint32 phase[SYNTH_MAX_VOICES]; // Fixed point, a full cycle is 2^32
+    Uint32 increment[SYNTH_MAX_VOICES];
+    float gain[SYNTH_MAX_VOICES];  // Peak level from the velocity
+    float level[SYNTH_MAX_VOICES]; // Envelope level at the end of the last block
+    float ramp_gain[SYNTH_MAX_VOICES]; // Gain ramp of the current block, see synth_update_envelopes()
+    float ramp_step[SYNTH_MAX_VOICES];
+    Uint8 state[SYNTH_MAX_VOICES];
+    bool sustained[SYNTH_MAX_VOICES]; // Key is up but the sustain pedal holds the note
+    Uint8 note[SYNTH_MAX_VOICES];
+    Uint32 started[SYNTH_MAX_VOICES];
+    const struct SampleData *sample[SYNTH_MAX_VOICES]; // NULL for a sine voice
+    Uint64 sample_pos[SYNTH_MAX_VOICES];  // 32.32 fixed point frame position
+    Uint64 sample_step[SYNTH_MAX_VOICES];
+    // Filter coefficients of the current block, see synth_update_envelopes(),
+    // and the integrator states
+    float filter_a1[SYNTH_MAX_VOICES];
+    float filter_a2[SYNTH_MAX_VOICES];
+    float filter_a3[SYNTH_MAX_VOICES];
+    float filter_ic1[SYNTH_MAX_VOICES];
+    float filter_ic2[SYNTH_MAX_VOICES];
+
+    // Voices that are sounding, only these are rendered
+    Uint8 active[SYNTH_MAX_VOICES];
+    int active_count;
+    // Fixed free list of the others, note on never scans the pool
+    Uint8 free_voices[SYNTH_MAX_VOICES];
+    int free_count;
+
+    Uint32 note_increment[SYNTH_NOTES]; // Phase increment of each note at sample_rate
+
+    // Channel gains for every pan position, built by synth_set_output()
+    float pan_table[SYNTH_PAN_STEPS][SYNTH_MAX_CHANNELS];
+
+    // Planar mix bus, channel c at mix + c * SYNTH_BLOCK_SIZE
+    float mix[SYNTH_MAX_CHANNELS * SYNTH_BLOCK_SIZE];
+    float voice_buffer[SYNTH_FILTER_LANES * SYNTH_BLOCK_SIZE]; // Voices before panning, one per filter lane
+} Synth;
+
+// `amplitude` is the output peak for a full mix in Sint16 units, the output
+// defaults to mono Sint16 without dither
+void synth_init(Synth *synth, int sample_rate, float amplitude);
+
+// Select the device sample format, AUDIO_F32SYS or AUDIO_S16SYS, and the
+// channel count, 1 to SYNTH_MAX_CHANNELS. Mixing is float either way, the
+// format only picks the final output stage. Channels are taken as a row of
+// speakers in channel order and a voice is panned between the two nearest
+// to its position with a constant power law; stereo is the usual left/right.
+bool synth_set_output(Synth *synth, SDL_AudioFormat format, int channels, bool dither);
+
+// Envelope times in seconds, sustain as a level in 0..1
+void synth_set_envelope(Synth *synth, float attack, float decay, float sustain, float release);
+
+// Per-voice resonant low-pass: cutoff in Hz, 0 bypasses the filter,
+// resonance in 0..1 and the envelope amount in octaves the cutoff rises at
+// full level. MIDI CC 74 and 71 set the cutoff and resonance as well.
+void synth_set_filter(Synth *synth, float cutoff, float resonance, float env_octaves);
+
+// One PARAM_ value. The output level ramps to its new value over a few
+// blocks and the cutoff is smoothed as from the controller, so a patch can
+// be retuned while it plays.
+void synth_set_param(Synth *synth, int param, float value);
+
+// PARAM_ value of a name such as "cutoff", as patch files and OSC spell
+// them, -1 for none
+int synth_find_param(const char *name);
+
+// Equal-tempered frequency of a MIDI note number
+double synth_note_frequency(int note);
+
+// Register an event source for synth_process(), before audio starts
+bool synth_attach_queue(Synth *synth, EventQueue *queue);
+
+void synth_note_on(Synth *synth, int note, int velocity);
+void synth_note_off(Synth *synth, int note);
+void synth_control(Synth *synth, int control, int value);
+int synth_active_voices(const Synth *synth);
+
+void synth_apply_event(Synth *synth, const SynthEvent *event);
+
+// Advance the envelope of every active voice by one block of `frames` and
+// store the linear gain ramp the oscillator applies over that block, and
+// the filter coefficients for the block when the filter is on. Voices that
+// finish their release are marked free and retired after rendering.
+void synth_update_envelopes(Synth *synth, int frames);
+
+// Render active voices first..last-1 for one block and add them, filtered
+// and panned, to the planar bus `bus`. `scratch` holds SYNTH_FILTER_LANES *
+// SYNTH_BLOCK_SIZE floats for the voices before panning. Envelopes must
+// already be updated for the block.
+void synth_render_voices(Synth *synth, int first, int last, float *bus, float *scratch, int frames);
+
+// Render `frames` interleaved frames into `out` in the output format, a
+// plain memset when no voice is active and the graph is quiet
+void synth_render(Synth *synth, void *out, int frames);
+
+// Audio thread entry point: drain the attached queues and render `frames`
+// samples, applying each event at the sample offset matching its timestamp.
+// Events from all queues are merged in time order. They are placed relative
+// to the start of the previous call, which trades one buffer of constant
+// latency for jitter-free timing. Sequencer steps split the buffer as well
+// and land on their exact frame.
+void synth_process(Synth *synth, void *out, int frames);
+
+#endif
@@ -0,0 +1,305 @@
+// DSP microbenchmarks for the synth render path. Prints one CSV line per
+// measurement so results can be diffed between releases or collected by
+// scripts:
+//
+//   stage,kernel,voices,block,samples_per_sec,ns_per_voice_sample
+//
+// Stages:
+//   oscillator  one voice kernel call (oscillator, gain ramp and accumulate)
+//   envelope    per-block envelope update of all voices
+//   filter      resonant low-pass of SYNTH_FILTER_LANES voices side by side
+//   output_s16  soft clip, dither, Sint16 conversion and interleave of the
+//               mix bus, suffixed with the channel count
+//   output_f32  soft clip and interleave to float output
+//   render      full synth_render() of all voices including block overhead
+//   render_filtered  the same with the voice filter on
+//
+// With --budget FILE every measurement is also held against the budget
+// lines of FILE, in the same columns up to the block size and then a
+// ceiling in nanoseconds per voice sample:
+//
+//   # stage,kernel,voices,block,max_ns_per_voice_sample
+//   render,*,16,256,2.5
+//
+// A kernel of "*" stands for the one the synth picks on this machine, the
+// kernel the audio callback runs. Any line over its budget, or a budget no
+// measurement matched, is reported on stderr and the exit status is 1.
+
+#define SDL_MAIN_HANDLED
+#include <SDL.h>
+#include <stdio.h>
+
+#include "synth.h"
+
+#define BENCH_MAX_BLOCK 4096
+#define BENCH_TIME_MS 50 // Minimum measuring time per line
+#define BENCH_MAX_BUDGETS 128
+
+static const int voice_counts[] = {1, 4, 16, 64};
+static const int block_sizes[] = {64, 256, 1024, 4096};
+
+static double bench_ms = BENCH_TIME_MS;
+static const int channel_counts[] = {1, 2, 8};
+
+static float mix[SYNTH_MAX_CHANNELS * BENCH_MAX_BLOCK]; // Planar, stride BENCH_MAX_BLOCK
+static Sint16 out[SYNTH_MAX_CHANNELS * BENCH_MAX_BLOCK];
+static float out_f32[SYNTH_MAX_CHANNELS * BENCH_MAX_BLOCK];
+static volatile Uint32 sink; // Keeps results alive past the optimizer
+
+typedef struct Budget
+{
+    char stage[32];
+    char kernel[16];
+    int voices;
+    int block;
+    double max_ns; // Per voice sample
+    bool matched;
+} Budget;
+
+static Budget budgets[BENCH_MAX_BUDGETS];
+static int budget_count = 0;
+static int budget_failures = 0;
+static const char *picked_kernel; // What "*" stands for in a budget
+
+static bool load_budgets(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[256];
+    int line_number = 0;
+
+    if (!file)
+    {
+        fprintf(stderr, "Cannot open budget file %s\n", path);
+        return false;
+    }
+    while (fgets(line, sizeof(line), file))
+    {
+        line_number++;
+        char *comment = SDL_strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        Budget budget;
+        SDL_zero(budget);
+        int fields = sscanf(line, " %31[^,],%15[^,],%d,%d,%lf", budget.stage, budget.kernel, &budget.voices,
+                            &budget.block, &budget.max_ns);
+        if (fields <= 0)
+            continue; // Blank line
+        if (fields != 5 || budget_count == BENCH_MAX_BUDGETS)
+        {
+            fprintf(stderr, "%s:%d: bad budget line\n", path, line_number);
+            fclose(file);
+            return false;
+        }
+        budgets[budget_count++] = budget;
+    }
+    fclose(file);
+    return true;
+}
+
+static void check_budgets(const char *stage, const char *kernel, int voices, int block, double ns)
+{
+    for (int i = 0; i < budget_count; i++)
+    {
+        Budget *budget = &budgets[i];
+        const char *wanted = SDL_strcmp(budget->kernel, "*") == 0 ? picked_kernel : budget->kernel;
+        if (SDL_strcmp(budget->stage, stage) != 0 || SDL_strcmp(wanted, kernel) != 0 || budget->voices != voices ||
+            budget->block != block)
+            continue;
+
+        budget->matched = true;
+        if (ns > budget->max_ns)
+        {
+            fprintf(stderr, "over budget: %s,%s,%d,%d %.4f ns per voice sample, budget %.4f\n", stage, kernel,
+                    voices, block, ns, budget->max_ns);
+            budget_failures++;
+        }
+    }
+}
+
+static double now_seconds(void)
+{
+    return (double)SDL_GetPerformanceCounter() / SDL_GetPerformanceFrequency();
+}
+
+static void report(const char *stage, const char *kernel, int voices, int block, double samples, double seconds)
+{
+    double per_sec = samples / seconds;
+    double ns = seconds * 1e9 / (samples * voices);
+    printf("%s,%s,%d,%d,%.0f,%.4f\n", stage, kernel, voices, block, per_sec, ns);
+    fflush(stdout);
+    check_budgets(stage, kernel, voices, block, ns);
+}
+
+// Run `body` in batches of 16 until bench_ms has passed, counting calls and total seconds
+#define TIMED(calls, body)                                   \
+    do                                                       \
+    {                                                        \
+        double start_ = now_seconds(), elapsed_ = 0.0;       \
+        calls = 0;                                           \
+        do                                                   \
+        {                                                    \
+            for (int rep_ = 0; rep_ < 16; rep_++)            \
+            {                                                \
+                body;                                        \
+            }                                                \
+            calls += 16;                                     \
+            elapsed_ = now_seconds() - start_;               \
+        } while (elapsed_ * 1000.0 < bench_ms);              \
+        seconds = elapsed_;                                  \
+    } while (0)
+
+static void bench_oscillator(const SynthKernels *k, int block)
+{
+    Uint32 phase = 0, increment = (Uint32)(440.0 / 44100.0 * 4294967296.0);
+    double seconds;
+    long calls;
+
+    SDL_memset(mix, 0, sizeof(mix));
+    TIMED(calls, phase = k->render_voice(mix, phase, increment, 0.25f, 1e-6f, block));
+    sink += phase;
+    report("oscillator", k->name, 1, block, (double)calls * block, seconds);
+}
+
+static void bench_filter(const SynthKernels *k, int block)
+{
+    float coefficients[3 * SYNTH_FILTER_LANES];
+    float state[2 * SYNTH_FILTER_LANES] = {0};
+    double seconds;
+    long calls;
+
+    // 1 kHz at 44.1 kHz with some resonance
+    for (int l = 0; l < SYNTH_FILTER_LANES; l++)
+    {
+        float g = 0.0715f, a1 = 1.0f / (1.0f + g * (g + 0.5f));
+        coefficients[l] = a1;
+        coefficients[SYNTH_FILTER_LANES + l] = g * a1;
+        coefficients[2 * SYNTH_FILTER_LANES + l] = g * g * a1;
+    }
+    for (int i = 0; i < SYNTH_FILTER_LANES * BENCH_MAX_BLOCK; i++)
+        mix[i] = (i % 100 - 50) * 0.01f;
+
+    TIMED(calls, k->filter_voices(mix, BENCH_MAX_BLOCK, coefficients, state, block));
+    sink += (Uint32)(state[0] * 100.0f);
+    report("filter", k->name, SYNTH_FILTER_LANES, block, (double)calls * block * SYNTH_FILTER_LANES, seconds);
+}
+
+// Output stages over a ramp that crosses the soft clip knee, rates are in
+// frames so the channel layouts compare directly
+static void bench_output(const SynthKernels *k, int channels, int block)
+{
+    Uint32 dither[SYNTH_DITHER_LANES] = {1, 2, 3, 4, 5, 6, 7, 8};
+    char stage[32];
+    double seconds;
+    long calls;
+
+    for (int i = 0; i < SYNTH_MAX_CHANNELS * BENCH_MAX_BLOCK; i++)
+        mix[i] = (i % 200 - 100) * 0.01f;
+
+    TIMED(calls, k->output_s16(out, mix, BENCH_MAX_BLOCK, channels, 0.85f, dither, block));
+    sink += (Uint32)out[block - 1];
+    SDL_snprintf(stage, sizeof(stage), "output_s16_%dch", channels);
+    report(stage, k->name, 1, block, (double)calls * block, seconds);
+
+    TIMED(calls, k->output_f32(out_f32, mix, BENCH_MAX_BLOCK, channels, 0.85f, block));
+    sink += (Uint32)(out_f32[block - 1] * 100.0f);
+    SDL_snprintf(stage, sizeof(stage), "output_f32_%dch", channels);
+    report(stage, k->name, 1, block, (double)calls * block, seconds);
+}
+
+static void bench_envelope(int voices, int block)
+{
+    static Synth synth;
+    double seconds;
+    long calls;
+
+    synth_init(&synth, 44100, 28000.0f);
+    for (int v = 0; v < voices; v++)
+        synth_note_on(&synth, 36 + v, 127);
+
+    // Long decay so the voices stay in one segment for the whole run
+    synth_set_envelope(&synth, 0.0f, 1000.0f, 0.5f, 1000.0f);
+    TIMED(calls, synth_update_envelopes(&synth, block));
+    sink += (Uint32)synth.active_count;
+    report("envelope", "scalar", voices, block, (double)calls * block, seconds);
+}
+
+static void bench_render(const SynthKernels *k, int voices, int block, bool filtered)
+{
+    static Synth synth;
+    double seconds;
+    long calls;
+
+    synth_init(&synth, 44100, 28000.0f);
+    synth.kernels = k;
+    if (filtered)
+        synth_set_filter(&synth, 1000.0f, 0.5f, 2.0f);
+    for (int v = 0; v < voices; v++)
+        synth_note_on(&synth, 36 + v, 127);
+
+    TIMED(calls, synth_render(&synth, out, block));
+    sink += (Uint32)out[0];
+    report(filtered ? "render_filtered" : "render", k->name, voices, block, (double)calls * block, seconds);
+}
+
+int main(int argc, char *argv[])
+{
+    const SynthKernels *kernels[8];
+    int kernel_count;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (SDL_strcmp(argv[i], "--time") == 0 && i + 1 < argc)
+            bench_ms = SDL_atof(argv[++i]);
+        else if (SDL_strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+        {
+            if (!load_budgets(argv[++i]))
+                return 1;
+        }
+        else
+        {
+            printf("usage: %s [--time MS] [--budget FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    synth_kernels_init();
+    picked_kernel = synth_kernels_detect()->name;
+    kernel_count = synth_kernels_available(kernels, (int)SDL_arraysize(kernels));
+
+    printf("stage,kernel,voices,block,samples_per_sec,ns_per_voice_sample\n");
+    for (size_t b = 0; b < SDL_arraysize(block_sizes); b++)
+    {
+        for (size_t v = 0; v < SDL_arraysize(voice_counts); v++)
+            bench_envelope(voice_counts[v], block_sizes[b]);
+    }
+    for (int k = 0; k < kernel_count; k++)
+    {
+        for (size_t b = 0; b < SDL_arraysize(block_sizes); b++)
+        {
+            bench_oscillator(kernels[k], block_sizes[b]);
+            bench_filter(kernels[k], block_sizes[b]);
+            for (size_t c = 0; c < SDL_arraysize(channel_counts); c++)
+                bench_output(kernels[k], channel_counts[c], block_sizes[b]);
+            for (size_t v = 0; v < SDL_arraysize(voice_counts); v++)
+            {
+                bench_render(kernels[k], voice_counts[v], block_sizes[b], false);
+                bench_render(kernels[k], voice_counts[v], block_sizes[b], true);
+            }
+        }
+    }
+
+    for (int i = 0; i < budget_count; i++)
+        if (!budgets[i].matched)
+        {
+            fprintf(stderr, "budget %s,%s,%d,%d matched no measurement\n", budgets[i].stage, budgets[i].kernel,
+                    budgets[i].voices, budgets[i].block);
+            budget_failures++;
+        }
+    if (budget_failures > 0)
+    {
+        fprintf(stderr, "%d budget checks failed\n", budget_failures);
+        return 1;
+    }
+    return 0;
+}
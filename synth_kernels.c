@@ -0,0 +1,840 @@
+#include "synth_kernels.h"
+
+#include <math.h>
+#include <stdbool.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// The SIMD kernels use the polynomial sine, a SYNTH_EXACT_SIN reference
+// build is scalar only and leaves them out altogether
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(SYNTH_EXACT_SIN)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+#if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(SYNTH_EXACT_SIN)
+#define KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define PHASE_FRACTION_BITS (32 - WAVETABLE_BITS)
+#define PHASE_FRACTION_MASK ((1u << PHASE_FRACTION_BITS) - 1)
+
+#define SOFT_KNEE 0.5f // Output level where soft clipping starts, -6 dBFS
+
+// One sine cycle plus a guard point so interpolation never wraps the index.
+// A pure sine has no harmonics, so the table is band-limited at any pitch.
+static float sine_table[WAVETABLE_SIZE + 1];
+static bool wavetable_ready = false;
+
+void synth_kernels_init(void)
+{
+    if (wavetable_ready)
+        return;
+
+    for (int i = 0; i <= WAVETABLE_SIZE; i++)
+        sine_table[i] = (float)sin(2.0 * M_PI * i / WAVETABLE_SIZE);
+    wavetable_ready = true;
+}
+
+// Scalar kernels
+
+// The phase accumulator wraps on its own through unsigned overflow, so there
+// is no branch in the loop
+static Uint32 render_voice_scalar(float *mix, Uint32 phase, Uint32 increment, float gain, float gain_step, int frames)
+{
+    for (int i = 0; i < frames; i++)
+    {
+#ifdef SYNTH_EXACT_SIN
+        mix[i] += gain * (float)sin(phase * (2.0 * M_PI / 4294967296.0));
+#else
+        Uint32 index = phase >> PHASE_FRACTION_BITS;
+        float fraction = (phase & PHASE_FRACTION_MASK) * (1.0f / (1u << PHASE_FRACTION_BITS));
+        float a = sine_table[index];
+        float b = sine_table[index + 1];
+        mix[i] += gain * (a + (b - a) * fraction);
+#endif
+        gain += gain_step;
+        phase += increment;
+    }
+    return phase;
+}
+
+// Output stage helpers. The soft clipper is transparent up to SOFT_KNEE and
+// bends smoothly towards full scale above it, with a continuous slope. The
+// same branch-free formula is used by every kernel set.
+static inline float soft_clip(float x)
+{
+    float a = fabsf(x);
+    float over = (a > SOFT_KNEE ? a - SOFT_KNEE : 0.0f) * (1.0f / (1.0f - SOFT_KNEE));
+    float y = (a < SOFT_KNEE ? a : SOFT_KNEE) + (1.0f - SOFT_KNEE) * over / (1.0f + over);
+    return copysignf(y, x);
+}
+
+// xorshift32, good enough for dither and cheap in every SIMD lane
+static inline Uint32 next_random(Uint32 *state)
+{
+    Uint32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Uniform float in [0, 1) from the top 23 bits
+static inline float random_unit(Uint32 r)
+{
+    union
+    {
+        Uint32 u;
+        float f;
+    } bits = {(r >> 9) | 0x3F800000u};
+    return bits.f - 1.0f;
+}
+
+static inline Sint16 to_s16(float x, Uint32 *dither)
+{
+    float sample = soft_clip(x) * 32767.0f;
+    if (dither)
+        sample += random_unit(next_random(&dither[0])) - random_unit(next_random(&dither[0]));
+    long value = lrintf(sample);
+    return (Sint16)(value > 32767 ? 32767 : value < -32768 ? -32768 : value);
+}
+
+static void accumulate_scalar(float *dst, const float *src, float gain, int frames)
+{
+    for (int i = 0; i < frames; i++)
+        dst[i] += src[i] * gain;
+}
+
+static void output_s16_scalar(Sint16 *out, const float *mix, int stride, int channels, float gain, Uint32 *dither,
+                              int frames)
+{
+    for (int i = 0; i < frames; i++)
+        for (int c = 0; c < channels; c++)
+            *out++ = to_s16(mix[c * stride + i] * gain, dither);
+}
+
+static void output_f32_scalar(float *out, const float *mix, int stride, int channels, float gain, int frames)
+{
+    for (int i = 0; i < frames; i++)
+        for (int c = 0; c < channels; c++)
+            *out++ = soft_clip(mix[c * stride + i] * gain);
+}
+
+// State-variable filter in the trapezoidal integrator form, stable for any
+// cutoff and resonance. Runs the lanes from frame `first` on, the SIMD
+// kernels hand their tails to it.
+static void filter_lanes_scalar(float *voices, int stride, const float *coefficients, float *state, int first,
+                                int frames)
+{
+    for (int l = 0; l < SYNTH_FILTER_LANES; l++)
+    {
+        float a1 = coefficients[l];
+        float a2 = coefficients[SYNTH_FILTER_LANES + l];
+        float a3 = coefficients[2 * SYNTH_FILTER_LANES + l];
+        float ic1 = state[l];
+        float ic2 = state[SYNTH_FILTER_LANES + l];
+        float *x = voices + l * stride;
+
+        for (int i = first; i < frames; i++)
+        {
+            float v3 = x[i] - ic2;
+            float v1 = a1 * ic1 + a2 * v3;
+            float v2 = ic2 + a2 * ic1 + a3 * v3;
+            ic1 = 2.0f * v1 - ic1;
+            ic2 = 2.0f * v2 - ic2;
+            x[i] = v2;
+        }
+        state[l] = ic1;
+        state[SYNTH_FILTER_LANES + l] = ic2;
+    }
+}
+
+static void filter_voices_scalar(float *voices, int stride, const float *coefficients, float *state, int frames)
+{
+    filter_lanes_scalar(voices, stride, coefficients, state, 0, frames);
+}
+
+const SynthKernels synth_kernels_scalar = {"scalar", render_voice_scalar, accumulate_scalar, filter_voices_scalar,
+                                           output_s16_scalar, output_f32_scalar};
+
+// Polynomial sine shared by the SIMD kernels. The phase is read as a signed
+// 32-bit value so t = phase / 2^31 covers [-1, 1) and the result is sin(pi t).
+// |t| is folded into [-0.5, 0.5] where an odd 9th order polynomial is accurate
+// to about 4e-6 (-108 dB).
+#define SIN_C1 3.14159265f
+#define SIN_C3 -5.16771278f
+#define SIN_C5 2.55016404f
+#define SIN_C7 -0.59926453f
+#define SIN_C9 0.08214589f
+#define PHASE_TO_UNIT (1.0f / 2147483648.0f)
+
+#if defined(KERNELS_X86) || defined(KERNELS_NEON)
+// Scalar version of the polynomial for the tails that do not fill a vector,
+// so the waveform stays continuous across the vector/scalar boundary
+static Uint32 render_voice_poly_tail(float *mix, Uint32 phase, Uint32 increment, float gain, float gain_step, int frames)
+{
+    for (int i = 0; i < frames; i++)
+    {
+        float t = (float)(Sint32)phase * PHASE_TO_UNIT;
+        float excess = fabsf(t) - 0.5f;
+        if (excess > 0.0f)
+            t -= copysignf(2.0f * excess, t);
+        float t2 = t * t;
+        float s = (((SIN_C9 * t2 + SIN_C7) * t2 + SIN_C5) * t2 + SIN_C3) * t2 + SIN_C1;
+        mix[i] += gain * s * t;
+        gain += gain_step;
+        phase += increment;
+    }
+    return phase;
+}
+#endif
+
+#ifdef KERNELS_X86
+
+// SSE2 kernels, 4 samples per iteration
+
+__attribute__((target("sse2"))) static inline __m128 sin_poly_sse2(__m128i phase)
+{
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    __m128 t = _mm_mul_ps(_mm_cvtepi32_ps(phase), _mm_set1_ps(PHASE_TO_UNIT));
+    __m128 sign = _mm_and_ps(t, sign_mask);
+    __m128 excess = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(sign_mask, t), _mm_set1_ps(0.5f)), _mm_setzero_ps());
+    t = _mm_sub_ps(t, _mm_or_ps(_mm_add_ps(excess, excess), sign));
+
+    __m128 t2 = _mm_mul_ps(t, t);
+    __m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_C9), t2), _mm_set1_ps(SIN_C7));
+    s = _mm_add_ps(_mm_mul_ps(s, t2), _mm_set1_ps(SIN_C5));
+    s = _mm_add_ps(_mm_mul_ps(s, t2), _mm_set1_ps(SIN_C3));
+    s = _mm_add_ps(_mm_mul_ps(s, t2), _mm_set1_ps(SIN_C1));
+    return _mm_mul_ps(s, t);
+}
+
+__attribute__((target("sse2"))) static Uint32 render_voice_sse2(float *mix, Uint32 phase, Uint32 increment, float gain, float gain_step, int frames)
+{
+    __m128i lanes = _mm_set_epi32((int)(phase + 3 * increment), (int)(phase + 2 * increment),
+                                  (int)(phase + increment), (int)phase);
+    __m128i step = _mm_set1_epi32((int)(4 * increment));
+    __m128 vgain = _mm_add_ps(_mm_set1_ps(gain), _mm_mul_ps(_mm_set1_ps(gain_step), _mm_setr_ps(0, 1, 2, 3)));
+    __m128 vgain_step = _mm_set1_ps(4.0f * gain_step);
+    int i = 0;
+
+    for (; i + 4 <= frames; i += 4)
+    {
+        __m128 s = _mm_mul_ps(sin_poly_sse2(lanes), vgain);
+        _mm_storeu_ps(mix + i, _mm_add_ps(_mm_loadu_ps(mix + i), s));
+        lanes = _mm_add_epi32(lanes, step);
+        vgain = _mm_add_ps(vgain, vgain_step);
+    }
+
+    phase += (Uint32)i * increment;
+    return render_voice_poly_tail(mix + i, phase, increment, gain + i * gain_step, gain_step, frames - i);
+}
+
+__attribute__((target("sse2"))) static inline __m128 soft_clip_sse2(__m128 x)
+{
+    const __m128 sign_mask = _mm_set1_ps(-0.0f);
+    const __m128 knee = _mm_set1_ps(SOFT_KNEE);
+    __m128 a = _mm_andnot_ps(sign_mask, x);
+    __m128 over = _mm_mul_ps(_mm_max_ps(_mm_sub_ps(a, knee), _mm_setzero_ps()), _mm_set1_ps(1.0f / (1.0f - SOFT_KNEE)));
+    __m128 bend = _mm_div_ps(_mm_mul_ps(_mm_set1_ps(1.0f - SOFT_KNEE), over), _mm_add_ps(_mm_set1_ps(1.0f), over));
+    return _mm_or_ps(_mm_add_ps(_mm_min_ps(a, knee), bend), _mm_and_ps(x, sign_mask));
+}
+
+__attribute__((target("sse2"))) static inline __m128i next_random_sse2(__m128i x)
+{
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+    return _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+}
+
+__attribute__((target("sse2"))) static inline __m128 random_unit_sse2(__m128i r)
+{
+    __m128i bits = _mm_or_si128(_mm_srli_epi32(r, 9), _mm_set1_epi32(0x3F800000));
+    return _mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.0f));
+}
+
+// Eight samples of one channel to Sint16, advancing the dither state if any
+__attribute__((target("sse2"))) static inline __m128i to_s16_sse2(const float *mix, __m128 gain, __m128i *rng)
+{
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    __m128 a = _mm_mul_ps(soft_clip_sse2(_mm_mul_ps(_mm_loadu_ps(mix), gain)), scale);
+    __m128 b = _mm_mul_ps(soft_clip_sse2(_mm_mul_ps(_mm_loadu_ps(mix + 4), gain)), scale);
+    if (rng)
+    {
+        // TPDF: difference of two uniform values, +-1 LSB
+        __m128i r1 = next_random_sse2(*rng), r2 = next_random_sse2(r1);
+        __m128i r3 = next_random_sse2(r2), r4 = next_random_sse2(r3);
+        a = _mm_add_ps(a, _mm_sub_ps(random_unit_sse2(r1), random_unit_sse2(r2)));
+        b = _mm_add_ps(b, _mm_sub_ps(random_unit_sse2(r3), random_unit_sse2(r4)));
+        *rng = r4;
+    }
+    // Round to nearest, packs saturates to Sint16
+    return _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+}
+
+__attribute__((target("sse2"))) static void accumulate_sse2(float *dst, const float *src, float gain, int frames)
+{
+    const __m128 vgain = _mm_set1_ps(gain);
+    int i = 0;
+
+    for (; i + 4 <= frames; i += 4)
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), vgain)));
+    accumulate_scalar(dst + i, src + i, gain, frames - i);
+}
+
+// One frame of the filter for all four voices
+__attribute__((target("sse2"))) static inline __m128 svf_step_sse2(__m128 x, __m128 a1, __m128 a2, __m128 a3, __m128 *ic1,
+                                                                   __m128 *ic2)
+{
+    __m128 v3 = _mm_sub_ps(x, *ic2);
+    __m128 v1 = _mm_add_ps(_mm_mul_ps(a1, *ic1), _mm_mul_ps(a2, v3));
+    __m128 v2 = _mm_add_ps(*ic2, _mm_add_ps(_mm_mul_ps(a2, *ic1), _mm_mul_ps(a3, v3)));
+    *ic1 = _mm_sub_ps(_mm_add_ps(v1, v1), *ic1);
+    *ic2 = _mm_sub_ps(_mm_add_ps(v2, v2), *ic2);
+    return v2;
+}
+
+// Four frames of the four voices per pass, transposed in registers so each
+// vector holds one frame of every voice and the recursion runs across lanes
+__attribute__((target("sse2"))) static void filter_voices_sse2(float *voices, int stride, const float *coefficients,
+                                                               float *state, int frames)
+{
+    const __m128 a1 = _mm_loadu_ps(coefficients);
+    const __m128 a2 = _mm_loadu_ps(coefficients + SYNTH_FILTER_LANES);
+    const __m128 a3 = _mm_loadu_ps(coefficients + 2 * SYNTH_FILTER_LANES);
+    __m128 ic1 = _mm_loadu_ps(state);
+    __m128 ic2 = _mm_loadu_ps(state + SYNTH_FILTER_LANES);
+    float *lane0 = voices, *lane1 = voices + stride, *lane2 = voices + 2 * stride, *lane3 = voices + 3 * stride;
+    int i = 0;
+
+    for (; i + 4 <= frames; i += 4)
+    {
+        __m128 f0 = _mm_loadu_ps(lane0 + i), f1 = _mm_loadu_ps(lane1 + i);
+        __m128 f2 = _mm_loadu_ps(lane2 + i), f3 = _mm_loadu_ps(lane3 + i);
+        _MM_TRANSPOSE4_PS(f0, f1, f2, f3);
+        f0 = svf_step_sse2(f0, a1, a2, a3, &ic1, &ic2);
+        f1 = svf_step_sse2(f1, a1, a2, a3, &ic1, &ic2);
+        f2 = svf_step_sse2(f2, a1, a2, a3, &ic1, &ic2);
+        f3 = svf_step_sse2(f3, a1, a2, a3, &ic1, &ic2);
+        _MM_TRANSPOSE4_PS(f0, f1, f2, f3);
+        _mm_storeu_ps(lane0 + i, f0);
+        _mm_storeu_ps(lane1 + i, f1);
+        _mm_storeu_ps(lane2 + i, f2);
+        _mm_storeu_ps(lane3 + i, f3);
+    }
+
+    _mm_storeu_ps(state, ic1);
+    _mm_storeu_ps(state + SYNTH_FILTER_LANES, ic2);
+    filter_lanes_scalar(voices, stride, coefficients, state, i, frames);
+}
+
+// Each pass converts a run of frames of every channel in registers and
+// interleaves on the way out: directly for mono, with unpacks for stereo and
+// through a small stack buffer for other layouts.
+__attribute__((target("sse2"))) static void output_s16_sse2(Sint16 *out, const float *mix, int stride, int channels,
+                                                            float gain, Uint32 *dither, int frames)
+{
+    const __m128 vgain = _mm_set1_ps(gain);
+    __m128i rng = dither ? _mm_loadu_si128((const __m128i *)dither) : _mm_setzero_si128();
+    __m128i *state = dither ? &rng : NULL;
+    int i = 0;
+
+    for (; i + 8 <= frames; i += 8, out += 8 * channels)
+    {
+        if (channels == 1)
+            _mm_storeu_si128((__m128i *)out, to_s16_sse2(mix + i, vgain, state));
+        else if (channels == 2)
+        {
+            __m128i left = to_s16_sse2(mix + i, vgain, state);
+            __m128i right = to_s16_sse2(mix + stride + i, vgain, state);
+            _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi16(left, right));
+            _mm_storeu_si128((__m128i *)(out + 8), _mm_unpackhi_epi16(left, right));
+        }
+        else
+        {
+            Sint16 planes[SYNTH_MAX_CHANNELS][8];
+            for (int c = 0; c < channels; c++)
+                _mm_storeu_si128((__m128i *)planes[c], to_s16_sse2(mix + c * stride + i, vgain, state));
+            for (int f = 0; f < 8; f++)
+                for (int c = 0; c < channels; c++)
+                    out[f * channels + c] = planes[c][f];
+        }
+    }
+
+    if (dither)
+        _mm_storeu_si128((__m128i *)dither, rng);
+    output_s16_scalar(out, mix + i, stride, channels, gain, dither, frames - i);
+}
+
+__attribute__((target("sse2"))) static void output_f32_sse2(float *out, const float *mix, int stride, int channels,
+                                                            float gain, int frames)
+{
+    const __m128 vgain = _mm_set1_ps(gain);
+    int i = 0;
+
+    for (; i + 4 <= frames; i += 4, out += 4 * channels)
+    {
+        if (channels == 1)
+            _mm_storeu_ps(out, soft_clip_sse2(_mm_mul_ps(_mm_loadu_ps(mix + i), vgain)));
+        else if (channels == 2)
+        {
+            __m128 left = soft_clip_sse2(_mm_mul_ps(_mm_loadu_ps(mix + i), vgain));
+            __m128 right = soft_clip_sse2(_mm_mul_ps(_mm_loadu_ps(mix + stride + i), vgain));
+            _mm_storeu_ps(out, _mm_unpacklo_ps(left, right));
+            _mm_storeu_ps(out + 4, _mm_unpackhi_ps(left, right));
+        }
+        else
+        {
+            float planes[SYNTH_MAX_CHANNELS][4];
+            for (int c = 0; c < channels; c++)
+                _mm_storeu_ps(planes[c], soft_clip_sse2(_mm_mul_ps(_mm_loadu_ps(mix + c * stride + i), vgain)));
+            for (int f = 0; f < 4; f++)
+                for (int c = 0; c < channels; c++)
+                    out[f * channels + c] = planes[c][f];
+        }
+    }
+    output_f32_scalar(out, mix + i, stride, channels, gain, frames - i);
+}
+
+static const SynthKernels synth_kernels_sse2 = {"sse2", render_voice_sse2, accumulate_sse2, filter_voices_sse2,
+                                                 output_s16_sse2, output_f32_sse2};
+
+// AVX2 kernels, 8 samples per iteration
+
+__attribute__((target("avx2"))) static inline __m256 sin_poly_avx2(__m256i phase)
+{
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    __m256 t = _mm256_mul_ps(_mm256_cvtepi32_ps(phase), _mm256_set1_ps(PHASE_TO_UNIT));
+    __m256 sign = _mm256_and_ps(t, sign_mask);
+    __m256 excess = _mm256_max_ps(_mm256_sub_ps(_mm256_andnot_ps(sign_mask, t), _mm256_set1_ps(0.5f)),
+                                  _mm256_setzero_ps());
+    t = _mm256_sub_ps(t, _mm256_or_ps(_mm256_add_ps(excess, excess), sign));
+
+    __m256 t2 = _mm256_mul_ps(t, t);
+    __m256 s = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_C9), t2), _mm256_set1_ps(SIN_C7));
+    s = _mm256_add_ps(_mm256_mul_ps(s, t2), _mm256_set1_ps(SIN_C5));
+    s = _mm256_add_ps(_mm256_mul_ps(s, t2), _mm256_set1_ps(SIN_C3));
+    s = _mm256_add_ps(_mm256_mul_ps(s, t2), _mm256_set1_ps(SIN_C1));
+    return _mm256_mul_ps(s, t);
+}
+
+__attribute__((target("avx2"))) static Uint32 render_voice_avx2(float *mix, Uint32 phase, Uint32 increment, float gain, float gain_step, int frames)
+{
+    __m256i lanes = _mm256_add_epi32(_mm256_set1_epi32((int)phase),
+                                     _mm256_mullo_epi32(_mm256_set1_epi32((int)increment),
+                                                        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+    __m256i step = _mm256_set1_epi32((int)(8 * increment));
+    __m256 vgain = _mm256_add_ps(_mm256_set1_ps(gain), _mm256_mul_ps(_mm256_set1_ps(gain_step),
+                                                                      _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)));
+    __m256 vgain_step = _mm256_set1_ps(8.0f * gain_step);
+    int i = 0;
+
+    for (; i + 8 <= frames; i += 8)
+    {
+        __m256 s = _mm256_mul_ps(sin_poly_avx2(lanes), vgain);
+        _mm256_storeu_ps(mix + i, _mm256_add_ps(_mm256_loadu_ps(mix + i), s));
+        lanes = _mm256_add_epi32(lanes, step);
+        vgain = _mm256_add_ps(vgain, vgain_step);
+    }
+
+    phase += (Uint32)i * increment;
+    return render_voice_poly_tail(mix + i, phase, increment, gain + i * gain_step, gain_step, frames - i);
+}
+
+__attribute__((target("avx2"))) static inline __m256 soft_clip_avx2(__m256 x)
+{
+    const __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    const __m256 knee = _mm256_set1_ps(SOFT_KNEE);
+    __m256 a = _mm256_andnot_ps(sign_mask, x);
+    __m256 over = _mm256_mul_ps(_mm256_max_ps(_mm256_sub_ps(a, knee), _mm256_setzero_ps()),
+                                _mm256_set1_ps(1.0f / (1.0f - SOFT_KNEE)));
+    __m256 bend = _mm256_div_ps(_mm256_mul_ps(_mm256_set1_ps(1.0f - SOFT_KNEE), over),
+                                _mm256_add_ps(_mm256_set1_ps(1.0f), over));
+    return _mm256_or_ps(_mm256_add_ps(_mm256_min_ps(a, knee), bend), _mm256_and_ps(x, sign_mask));
+}
+
+__attribute__((target("avx2"))) static inline __m256i next_random_avx2(__m256i x)
+{
+    x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+    return _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+}
+
+__attribute__((target("avx2"))) static inline __m256 random_unit_avx2(__m256i r)
+{
+    __m256i bits = _mm256_or_si256(_mm256_srli_epi32(r, 9), _mm256_set1_epi32(0x3F800000));
+    return _mm256_sub_ps(_mm256_castsi256_ps(bits), _mm256_set1_ps(1.0f));
+}
+
+// Sixteen samples of one channel to Sint16 in frame order
+__attribute__((target("avx2"))) static inline __m256i to_s16_avx2(const float *mix, __m256 gain, __m256i *rng)
+{
+    const __m256 scale = _mm256_set1_ps(32767.0f);
+    __m256 a = _mm256_mul_ps(soft_clip_avx2(_mm256_mul_ps(_mm256_loadu_ps(mix), gain)), scale);
+    __m256 b = _mm256_mul_ps(soft_clip_avx2(_mm256_mul_ps(_mm256_loadu_ps(mix + 8), gain)), scale);
+    if (rng)
+    {
+        __m256i r1 = next_random_avx2(*rng), r2 = next_random_avx2(r1);
+        __m256i r3 = next_random_avx2(r2), r4 = next_random_avx2(r3);
+        a = _mm256_add_ps(a, _mm256_sub_ps(random_unit_avx2(r1), random_unit_avx2(r2)));
+        b = _mm256_add_ps(b, _mm256_sub_ps(random_unit_avx2(r3), random_unit_avx2(r4)));
+        *rng = r4;
+    }
+    // packs works per 128-bit lane, put the quadwords back in order
+    __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+    return _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+__attribute__((target("avx2"))) static void accumulate_avx2(float *dst, const float *src, float gain, int frames)
+{
+    const __m256 vgain = _mm256_set1_ps(gain);
+    int i = 0;
+
+    for (; i + 8 <= frames; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), vgain)));
+    accumulate_scalar(dst + i, src + i, gain, frames - i);
+}
+
+// Same layout handling as the SSE2 kernels. The unpacks work within 128-bit
+// lanes, so stereo takes one cross-lane permute per output vector.
+__attribute__((target("avx2"))) static void output_s16_avx2(Sint16 *out, const float *mix, int stride, int channels,
+                                                            float gain, Uint32 *dither, int frames)
+{
+    const __m256 vgain = _mm256_set1_ps(gain);
+    __m256i rng = dither ? _mm256_loadu_si256((const __m256i *)dither) : _mm256_setzero_si256();
+    __m256i *state = dither ? &rng : NULL;
+    int i = 0;
+
+    for (; i + 16 <= frames; i += 16, out += 16 * channels)
+    {
+        if (channels == 1)
+            _mm256_storeu_si256((__m256i *)out, to_s16_avx2(mix + i, vgain, state));
+        else if (channels == 2)
+        {
+            __m256i left = to_s16_avx2(mix + i, vgain, state);
+            __m256i right = to_s16_avx2(mix + stride + i, vgain, state);
+            __m256i lo = _mm256_unpacklo_epi16(left, right), hi = _mm256_unpackhi_epi16(left, right);
+            _mm256_storeu_si256((__m256i *)out, _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i *)(out + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+        else
+        {
+            Sint16 planes[SYNTH_MAX_CHANNELS][16];
+            for (int c = 0; c < channels; c++)
+                _mm256_storeu_si256((__m256i *)planes[c], to_s16_avx2(mix + c * stride + i, vgain, state));
+            for (int f = 0; f < 16; f++)
+                for (int c = 0; c < channels; c++)
+                    out[f * channels + c] = planes[c][f];
+        }
+    }
+
+    if (dither)
+        _mm256_storeu_si256((__m256i *)dither, rng);
+    output_s16_scalar(out, mix + i, stride, channels, gain, dither, frames - i);
+}
+
+__attribute__((target("avx2"))) static void output_f32_avx2(float *out, const float *mix, int stride, int channels,
+                                                            float gain, int frames)
+{
+    const __m256 vgain = _mm256_set1_ps(gain);
+    int i = 0;
+
+    for (; i + 8 <= frames; i += 8, out += 8 * channels)
+    {
+        if (channels == 1)
+            _mm256_storeu_ps(out, soft_clip_avx2(_mm256_mul_ps(_mm256_loadu_ps(mix + i), vgain)));
+        else if (channels == 2)
+        {
+            __m256 left = soft_clip_avx2(_mm256_mul_ps(_mm256_loadu_ps(mix + i), vgain));
+            __m256 right = soft_clip_avx2(_mm256_mul_ps(_mm256_loadu_ps(mix + stride + i), vgain));
+            __m256 lo = _mm256_unpacklo_ps(left, right), hi = _mm256_unpackhi_ps(left, right);
+            _mm256_storeu_ps(out, _mm256_permute2f128_ps(lo, hi, 0x20));
+            _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+        }
+        else
+        {
+            float planes[SYNTH_MAX_CHANNELS][8];
+            for (int c = 0; c < channels; c++)
+                _mm256_storeu_ps(planes[c], soft_clip_avx2(_mm256_mul_ps(_mm256_loadu_ps(mix + c * stride + i), vgain)));
+            for (int f = 0; f < 8; f++)
+                for (int c = 0; c < channels; c++)
+                    out[f * channels + c] = planes[c][f];
+        }
+    }
+    output_f32_scalar(out, mix + i, stride, channels, gain, frames - i);
+}
+
+// The filter stays on four voices: its cost is the dependency chain through
+// every frame, not the lane count
+static const SynthKernels synth_kernels_avx2 = {"avx2", render_voice_avx2, accumulate_avx2, filter_voices_sse2,
+                                                 output_s16_avx2, output_f32_avx2};
+
+#endif // KERNELS_X86
+
+#ifdef KERNELS_NEON
+
+// NEON kernels, 4 samples per iteration
+
+static inline float32x4_t sin_poly_neon(int32x4_t phase)
+{
+    float32x4_t t = vmulq_n_f32(vcvtq_f32_s32(phase), PHASE_TO_UNIT);
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(t), vdupq_n_u32(0x80000000u));
+    float32x4_t excess = vmaxq_f32(vsubq_f32(vabsq_f32(t), vdupq_n_f32(0.5f)), vdupq_n_f32(0.0f));
+    float32x4_t fold = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(vaddq_f32(excess, excess)), sign));
+    t = vsubq_f32(t, fold);
+
+    float32x4_t t2 = vmulq_f32(t, t);
+    float32x4_t s = vmlaq_f32(vdupq_n_f32(SIN_C7), vdupq_n_f32(SIN_C9), t2);
+    s = vmlaq_f32(vdupq_n_f32(SIN_C5), s, t2);
+    s = vmlaq_f32(vdupq_n_f32(SIN_C3), s, t2);
+    s = vmlaq_f32(vdupq_n_f32(SIN_C1), s, t2);
+    return vmulq_f32(s, t);
+}
+
+static Uint32 render_voice_neon(float *mix, Uint32 phase, Uint32 increment, float gain, float gain_step, int frames)
+{
+    const Uint32 offsets[4] = {0, 1, 2, 3};
+    uint32x4_t lanes = vmlaq_n_u32(vdupq_n_u32(phase), vld1q_u32(offsets), increment);
+    uint32x4_t step = vdupq_n_u32(4 * increment);
+    const float gain_offsets[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+    float32x4_t vgain = vmlaq_n_f32(vdupq_n_f32(gain), vld1q_f32(gain_offsets), gain_step);
+    float32x4_t vgain_step = vdupq_n_f32(4.0f * gain_step);
+    int i = 0;
+
+    for (; i + 4 <= frames; i += 4)
+    {
+        float32x4_t s = sin_poly_neon(vreinterpretq_s32_u32(lanes));
+        vst1q_f32(mix + i, vmlaq_f32(vld1q_f32(mix + i), s, vgain));
+        lanes = vaddq_u32(lanes, step);
+        vgain = vaddq_f32(vgain, vgain_step);
+    }
+
+    phase += (Uint32)i * increment;
+    return render_voice_poly_tail(mix + i, phase, increment, gain + i * gain_step, gain_step, frames - i);
+}
+
+static inline float32x4_t soft_clip_neon(float32x4_t x)
+{
+    const float32x4_t knee = vdupq_n_f32(SOFT_KNEE);
+    float32x4_t a = vabsq_f32(x);
+    float32x4_t over = vmulq_n_f32(vmaxq_f32(vsubq_f32(a, knee), vdupq_n_f32(0.0f)), 1.0f / (1.0f - SOFT_KNEE));
+    float32x4_t denom = vaddq_f32(vdupq_n_f32(1.0f), over);
+    // Reciprocal estimate plus two Newton steps, ARMv7 has no vector divide
+    float32x4_t inv = vrecpeq_f32(denom);
+    inv = vmulq_f32(inv, vrecpsq_f32(denom, inv));
+    inv = vmulq_f32(inv, vrecpsq_f32(denom, inv));
+    float32x4_t y = vmlaq_n_f32(vminq_f32(a, knee), vmulq_f32(over, inv), 1.0f - SOFT_KNEE);
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(x), vdupq_n_u32(0x80000000u));
+    return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(y), sign));
+}
+
+static inline uint32x4_t next_random_neon(uint32x4_t x)
+{
+    x = veorq_u32(x, vshlq_n_u32(x, 13));
+    x = veorq_u32(x, vshrq_n_u32(x, 17));
+    return veorq_u32(x, vshlq_n_u32(x, 5));
+}
+
+static inline float32x4_t random_unit_neon(uint32x4_t r)
+{
+    uint32x4_t bits = vorrq_u32(vshrq_n_u32(r, 9), vdupq_n_u32(0x3F800000u));
+    return vsubq_f32(vreinterpretq_f32_u32(bits), vdupq_n_f32(1.0f));
+}
+
+// Float to int32 rounding to nearest
+static inline int32x4_t round_neon(float32x4_t x)
+{
+#ifdef __aarch64__
+    return vcvtnq_s32_f32(x);
+#else
+    uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(x), vdupq_n_u32(0x80000000u));
+    float32x4_t half = vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(vdupq_n_f32(0.5f)), sign));
+    return vcvtq_s32_f32(vaddq_f32(x, half));
+#endif
+}
+
+// Eight samples of one channel to Sint16, vcvt saturates to int32 and
+// vqmovn saturates again to int16
+static inline int16x8_t to_s16_neon(const float *mix, float gain, uint32x4_t *rng)
+{
+    float32x4_t a = vmulq_n_f32(soft_clip_neon(vmulq_n_f32(vld1q_f32(mix), gain)), 32767.0f);
+    float32x4_t b = vmulq_n_f32(soft_clip_neon(vmulq_n_f32(vld1q_f32(mix + 4), gain)), 32767.0f);
+    if (rng)
+    {
+        uint32x4_t r1 = next_random_neon(*rng), r2 = next_random_neon(r1);
+        uint32x4_t r3 = next_random_neon(r2), r4 = next_random_neon(r3);
+        a = vaddq_f32(a, vsubq_f32(random_unit_neon(r1), random_unit_neon(r2)));
+        b = vaddq_f32(b, vsubq_f32(random_unit_neon(r3), random_unit_neon(r4)));
+        *rng = r4;
+    }
+    return vcombine_s16(vqmovn_s32(round_neon(a)), vqmovn_s32(round_neon(b)));
+}
+
+static void accumulate_neon(float *dst, const float *src, float gain, int frames)
+{
+    int i = 0;
+
+    for (; i + 4 <= frames; i += 4)
+        vst1q_f32(dst + i, vmlaq_n_f32(vld1q_f32(dst + i), vld1q_f32(src + i), gain));
+    accumulate_scalar(dst + i, src + i, gain, frames - i);
+}
+
+static inline float32x4_t svf_step_neon(float32x4_t x, float32x4_t a1, float32x4_t a2, float32x4_t a3,
+                                        float32x4_t *ic1, float32x4_t *ic2)
+{
+    float32x4_t v3 = vsubq_f32(x, *ic2);
+    float32x4_t v1 = vmlaq_f32(vmulq_f32(a1, *ic1), a2, v3);
+    float32x4_t v2 = vmlaq_f32(vmlaq_f32(*ic2, a2, *ic1), a3, v3);
+    *ic1 = vsubq_f32(vaddq_f32(v1, v1), *ic1);
+    *ic2 = vsubq_f32(vaddq_f32(v2, v2), *ic2);
+    return v2;
+}
+
+// 4x4 transpose, row r of the result holds element r of each input
+static inline void transpose_neon(float32x4_t *f0, float32x4_t *f1, float32x4_t *f2, float32x4_t *f3)
+{
+    float32x4x2_t t01 = vtrnq_f32(*f0, *f1);
+    float32x4x2_t t23 = vtrnq_f32(*f2, *f3);
+    *f0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    *f1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    *f2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    *f3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+// Same layout as the SSE2 filter, one voice per lane
+static void filter_voices_neon(float *voices, int stride, const float *coefficients, float *state, int frames)
+{
+    const float32x4_t a1 = vld1q_f32(coefficients);
+    const float32x4_t a2 = vld1q_f32(coefficients + SYNTH_FILTER_LANES);
+    const float32x4_t a3 = vld1q_f32(coefficients + 2 * SYNTH_FILTER_LANES);
+    float32x4_t ic1 = vld1q_f32(state);
+    float32x4_t ic2 = vld1q_f32(state + SYNTH_FILTER_LANES);
+    float *lane0 = voices, *lane1 = voices + stride, *lane2 = voices + 2 * stride, *lane3 = voices + 3 * stride;
+    int i = 0;
+
+    for (; i + 4 <= frames; i += 4)
+    {
+        float32x4_t f0 = vld1q_f32(lane0 + i), f1 = vld1q_f32(lane1 + i);
+        float32x4_t f2 = vld1q_f32(lane2 + i), f3 = vld1q_f32(lane3 + i);
+        transpose_neon(&f0, &f1, &f2, &f3);
+        f0 = svf_step_neon(f0, a1, a2, a3, &ic1, &ic2);
+        f1 = svf_step_neon(f1, a1, a2, a3, &ic1, &ic2);
+        f2 = svf_step_neon(f2, a1, a2, a3, &ic1, &ic2);
+        f3 = svf_step_neon(f3, a1, a2, a3, &ic1, &ic2);
+        transpose_neon(&f0, &f1, &f2, &f3);
+        vst1q_f32(lane0 + i, f0);
+        vst1q_f32(lane1 + i, f1);
+        vst1q_f32(lane2 + i, f2);
+        vst1q_f32(lane3 + i, f3);
+    }
+
+    vst1q_f32(state, ic1);
+    vst1q_f32(state + SYNTH_FILTER_LANES, ic2);
+    filter_lanes_scalar(voices, stride, coefficients, state, i, frames);
+}
+
+// The structured stores interleave stereo in a single instruction
+static void output_s16_neon(Sint16 *out, const float *mix, int stride, int channels, float gain, Uint32 *dither,
+                            int frames)
+{
+    uint32x4_t rng = dither ? vld1q_u32(dither) : vdupq_n_u32(0);
+    uint32x4_t *state = dither ? &rng : NULL;
+    int i = 0;
+
+    for (; i + 8 <= frames; i += 8, out += 8 * channels)
+    {
+        if (channels == 1)
+            vst1q_s16(out, to_s16_neon(mix + i, gain, state));
+        else if (channels == 2)
+        {
+            int16x8x2_t frame;
+            frame.val[0] = to_s16_neon(mix + i, gain, state);
+            frame.val[1] = to_s16_neon(mix + stride + i, gain, state);
+            vst2q_s16(out, frame);
+        }
+        else
+        {
+            Sint16 planes[SYNTH_MAX_CHANNELS][8];
+            for (int c = 0; c < channels; c++)
+                vst1q_s16(planes[c], to_s16_neon(mix + c * stride + i, gain, state));
+            for (int f = 0; f < 8; f++)
+                for (int c = 0; c < channels; c++)
+                    out[f * channels + c] = planes[c][f];
+        }
+    }
+
+    if (dither)
+        vst1q_u32(dither, rng);
+    output_s16_scalar(out, mix + i, stride, channels, gain, dither, frames - i);
+}
+
+static void output_f32_neon(float *out, const float *mix, int stride, int channels, float gain, int frames)
+{
+    int i = 0;
+
+    for (; i + 4 <= frames; i += 4, out += 4 * channels)
+    {
+        if (channels == 1)
+            vst1q_f32(out, soft_clip_neon(vmulq_n_f32(vld1q_f32(mix + i), gain)));
+        else if (channels == 2)
+        {
+            float32x4x2_t frame;
+            frame.val[0] = soft_clip_neon(vmulq_n_f32(vld1q_f32(mix + i), gain));
+            frame.val[1] = soft_clip_neon(vmulq_n_f32(vld1q_f32(mix + stride + i), gain));
+            vst2q_f32(out, frame);
+        }
+        else
+        {
+            float planes[SYNTH_MAX_CHANNELS][4];
+            for (int c = 0; c < channels; c++)
+                vst1q_f32(planes[c], soft_clip_neon(vmulq_n_f32(vld1q_f32(mix + c * stride + i), gain)));
+            for (int f = 0; f < 4; f++)
+                for (int c = 0; c < channels; c++)
+                    out[f * channels + c] = planes[c][f];
+        }
+    }
+    output_f32_scalar(out, mix + i, stride, channels, gain, frames - i);
+}
+
+static const SynthKernels synth_kernels_neon = {"neon", render_voice_neon, accumulate_neon, filter_voices_neon,
+                                                 output_s16_neon, output_f32_neon};
+
+#endif // KERNELS_NEON
+
+const SynthKernels *synth_kernels_detect(void)
+{
+#ifdef KERNELS_X86
+    if (SDL_HasAVX2())
+        return &synth_kernels_avx2;
+    if (SDL_HasSSE2())
+        return &synth_kernels_sse2;
+#endif
+#ifdef KERNELS_NEON
+    if (SDL_HasNEON())
+        return &synth_kernels_neon;
+#endif
+    return &synth_kernels_scalar;
+}
+
+int synth_kernels_available(const SynthKernels **list, int max)
+{
+    int count = 0;
+
+#ifdef KERNELS_X86
+    if (SDL_HasAVX2() && count < max)
+        list[count++] = &synth_kernels_avx2;
+    if (SDL_HasSSE2() && count < max)
+        list[count++] = &synth_kernels_sse2;
+#endif
+#ifdef KERNELS_NEON
+    if (SDL_HasNEON() && count < max)
+        list[count++] = &synth_kernels_neon;
+#endif
+    if (count < max)
+        list[count++] = &synth_kernels_scalar;
+    return count;
+}
@@ -0,0 +1,56 @@
+#ifndef SYNTH_KERNELS_H
+#define SYNTH_KERNELS_H
+
+#include <SDL.h>
+
+#define WAVETABLE_BITS 11
+#define WAVETABLE_SIZE (1 << WAVETABLE_BITS)
+#define SYNTH_DITHER_LANES 8 // One dither random state per lane of the widest kernel
+#define SYNTH_MAX_CHANNELS 8 // Output channels the kernels can interleave
+#define SYNTH_FILTER_LANES 4 // Voices filtered side by side, one per SIMD lane
+
+// Inner loops of the renderer. There is one set per instruction set and the
+// best one the CPU supports is picked at runtime.
+typedef struct SynthKernels
+{
+    const char *name;
+
+    // Add `frames` samples of a sine voice into `mix`, scaled by a gain that
+    // starts at `gain` and changes by `gain_step` per sample. Returns the
+    // phase after the last sample.
+    Uint32 (*render_voice)(float *mix, Uint32 phase, Uint32 increment, float gain, float gain_step, int frames);
+
+    // dst += src * gain, used to pan a rendered voice into each channel
+    void (*accumulate)(float *dst, const float *src, float gain, int frames);
+
+    // Resonant state-variable low-pass over SYNTH_FILTER_LANES voices at
+    // once, in place. Voice l is at voices + l * stride. `coefficients`
+    // holds the a1, a2 and a3 of every lane as three runs of
+    // SYNTH_FILTER_LANES values and `state` the two integrator states the
+    // same way; they stay fixed over the call and the state is updated.
+    void (*filter_voices)(float *voices, int stride, const float *coefficients, float *state, int frames);
+
+    // Final output stage, the only conversion a sample goes through: scale
+    // the float mix bus by `gain` (1.0 is full scale), soft clip, then either
+    // write float or add optional TPDF dither and convert to Sint16. The bus
+    // is planar, channel c starts at mix + c * stride, and the output is
+    // interleaved in the same pass. `dither` holds SYNTH_DITHER_LANES random
+    // states, NULL disables dither.
+    void (*output_s16)(Sint16 *out, const float *mix, int stride, int channels, float gain, Uint32 *dither,
+                       int frames);
+    void (*output_f32)(float *out, const float *mix, int stride, int channels, float gain, int frames);
+} SynthKernels;
+
+// Build the shared wavetable, safe to call more than once
+void synth_kernels_init(void);
+
+// Fastest kernels for this CPU. The SIMD kernels use a polynomial sine, so
+// builds with SYNTH_EXACT_SIN always get the scalar kernels.
+const SynthKernels *synth_kernels_detect(void);
+
+extern const SynthKernels synth_kernels_scalar;
+
+// Every kernel set this CPU can run, fastest first, returns how many were stored
+int synth_kernels_available(const SynthKernels **list, int max);
+
+#endif
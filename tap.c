@@ -0,0 +1,58 @@
+#include "tap.h"
+
+#define TAP_FRESH 4 // Flag next to the middle slot index
+
+bool tap_init(Tap *tap, AudioArena *arena, int frame_bytes, int window, int max_frames)
+{
+    SDL_zerop(tap);
+    tap->frame_bytes = frame_bytes;
+    tap->window = window;
+    tap->capacity = window + max_frames;
+    for (int s = 0; s < TAP_SLOTS; s++)
+    {
+        tap->slots[s] = audio_arena_alloc(arena, (size_t)tap->capacity * frame_bytes);
+        if (!tap->slots[s])
+            return false;
+    }
+    tap->back = 0;
+    SDL_AtomicSet(&tap->middle, 1);
+    tap->front = 2;
+    return true;
+}
+
+void tap_write(Tap *tap, const void *data, int frames)
+{
+    const Uint8 *bytes = data;
+    int fill = tap->fill[tap->back];
+
+    // Buffers never exceed max_frames, keep the newest part if one does
+    if (frames > tap->capacity)
+    {
+        bytes += (size_t)(frames - tap->capacity) * tap->frame_bytes;
+        frames = tap->capacity;
+    }
+    if (fill + frames > tap->capacity)
+        fill = 0;
+
+    SDL_memcpy(tap->slots[tap->back] + (size_t)fill * tap->frame_bytes, bytes, (size_t)frames * tap->frame_bytes);
+    fill += frames;
+    tap->fill[tap->back] = fill;
+    if (fill < tap->window)
+        return;
+
+    // Publish the slot contents and fill before the index
+    SDL_MemoryBarrierRelease();
+    tap->back = SDL_AtomicSet(&tap->middle, tap->back | TAP_FRESH) & (TAP_FRESH - 1);
+    tap->fill[tap->back] = 0;
+}
+
+const Uint8 *tap_read(Tap *tap)
+{
+    if (!(SDL_AtomicGet(&tap->middle) & TAP_FRESH))
+        return NULL;
+
+    // Only the writer sets the flag, so the slot taken here is the fresh one
+    tap->front = SDL_AtomicSet(&tap->middle, tap->front) & (TAP_FRESH - 1);
+    SDL_MemoryBarrierAcquire();
+    return tap->slots[tap->front] + (size_t)(tap->fill[tap->front] - tap->window) * tap->frame_bytes;
+}
@@ -0,0 +1,40 @@
+#ifndef TAP_H
+#define TAP_H
+
+#include <SDL.h>
+#include <stdbool.h>
+
+#include "audio_memory.h"
+
+#define TAP_SLOTS 3
+
+// Wait-free triple buffer carrying the device output to one reader. The
+// audio thread appends each rendered buffer to its back slot with a single
+// memcpy and, once the slot holds `window` frames, swaps it with the shared
+// middle slot. The reader swaps the middle slot with its front one whenever
+// it is marked fresh. Neither side ever waits, the writer simply overwrites
+// windows the reader was too slow to take.
+typedef struct Tap
+{
+    SDL_atomic_t middle; // Shared slot index, TAP_FRESH once the writer published it
+    int back;            // Audio thread
+    int front;           // Reader
+    int frame_bytes;
+    int window;   // Frames published at a time
+    int capacity; // Frames per slot, a window plus the largest buffer
+    int fill[TAP_SLOTS];
+    Uint8 *slots[TAP_SLOTS];
+} Tap;
+
+// Carve the slots for `window` frames of `frame_bytes` each from `arena`,
+// `max_frames` is the largest buffer tap_write() will be given
+bool tap_init(Tap *tap, AudioArena *arena, int frame_bytes, int window, int max_frames);
+
+// Audio thread: add one rendered buffer in the device format
+void tap_write(Tap *tap, const void *data, int frames);
+
+// Reader: the latest window of `window` frames, or NULL when nothing was
+// published since the previous call
+const Uint8 *tap_read(Tap *tap);
+
+#endif
@@ -0,0 +1,99 @@
+#include "trace.h"
+
+#include <stdio.h>
+
+static char *trace_path = NULL;
+static Uint64 trace_start;
+static TraceRing rings[TRACE_MAX_RINGS];
+static int ring_count = 0;
+
+bool trace_open(const char *path)
+{
+    trace_path = SDL_strdup(path);
+    trace_start = SDL_GetPerformanceCounter();
+    return trace_path != NULL;
+}
+
+TraceRing *trace_ring(const char *thread_name)
+{
+    if (!trace_path || ring_count == TRACE_MAX_RINGS)
+        return NULL;
+
+    TraceRing *ring = &rings[ring_count];
+    ring->events = SDL_malloc(TRACE_RING_EVENTS * sizeof(TraceEvent));
+    if (!ring->events)
+    {
+        SDL_Log("Out of memory for the %s trace", thread_name);
+        return NULL;
+    }
+    // Fault the pages in now rather than on the traced thread's first lap
+    SDL_memset(ring->events, 0, TRACE_RING_EVENTS * sizeof(TraceEvent));
+    SDL_strlcpy(ring->thread_name, thread_name, sizeof(ring->thread_name));
+    ring->count = 0;
+    ring_count++;
+    return ring;
+}
+
+// The kept events of one thread, oldest first. A wrapped ring can start
+// inside a slice, its unmatched ends are left out.
+static Uint64 write_ring(FILE *file, const TraceRing *ring, int tid, bool *first)
+{
+    double scale = 1e6 / SDL_GetPerformanceFrequency(); // Microseconds
+    Uint32 kept = SDL_min(ring->count, (Uint32)TRACE_RING_EVENTS);
+    Uint64 written = 0;
+    int depth = 0;
+
+    fprintf(file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            *first ? "" : ",", tid, ring->thread_name);
+    *first = false;
+
+    for (Uint32 i = ring->count - kept; i != ring->count; i++)
+    {
+        const TraceEvent *event = &ring->events[i & (TRACE_RING_EVENTS - 1)];
+        if (event->phase == 'E' && depth == 0)
+            continue;
+        depth += event->phase == 'B' ? 1 : -1;
+
+        double ts = event->time > trace_start ? (event->time - trace_start) * scale : 0.0;
+        fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}", event->name,
+                event->phase, ts, tid);
+        written++;
+    }
+    return written;
+}
+
+void trace_close(void)
+{
+    if (!trace_path)
+        return;
+
+    FILE *file = fopen(trace_path, "w");
+    if (file)
+    {
+        Uint64 events = 0;
+        bool first = true, wrapped = false;
+
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+        for (int r = 0; r < ring_count; r++)
+        {
+            events += write_ring(file, &rings[r], r + 1, &first);
+            wrapped = wrapped || rings[r].count > TRACE_RING_EVENTS;
+        }
+        fprintf(file, "\n]}\n");
+
+        if (fclose(file) == 0)
+            SDL_Log("Trace: %llu events of %d threads written to %s%s", (unsigned long long)events, ring_count,
+                    trace_path, wrapped ? ", the oldest were overwritten" : "");
+        else
+            SDL_Log("Error writing trace %s", trace_path);
+    }
+    else
+        SDL_Log("Cannot write trace %s", trace_path);
+
+    for (int r = 0; r < ring_count; r++)
+        SDL_free(rings[r].events);
+    SDL_zeroa(rings);
+    ring_count = 0;
+    SDL_free(trace_path);
+    trace_path = NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <SDL.h>
+#include <stdbool.h>
+
+#define TRACE_RING_EVENTS (1 << 17) // Per thread, must be a power of two; the oldest are overwritten
+#define TRACE_MAX_RINGS 16
+
+typedef struct TraceEvent
+{
+    Uint64 time;      // SDL_GetPerformanceCounter()
+    const char *name; // A string literal, it is only read when the trace is written
+    char phase;       // 'B' begin or 'E' end, as in the Chrome trace format
+} TraceEvent;
+
+// Events of one thread. Only that thread writes and the ring is read once
+// it has stopped, so recording is a store and an increment, never a wait.
+typedef struct TraceRing
+{
+    char thread_name[32];
+    Uint32 count; // Events recorded, the latest TRACE_RING_EVENTS are kept
+    TraceEvent *events;
+} TraceRing;
+
+// Turn tracing on, trace_close() writes the file. Main thread, before any
+// traced thread starts.
+bool trace_open(const char *path);
+
+// Main thread: a ring for a thread about to start, NULL when tracing is off.
+// The calls below take the NULL ring and then only test it, that is all
+// tracing costs while it is off.
+TraceRing *trace_ring(const char *thread_name);
+
+static inline void trace_event(TraceRing *ring, const char *name, char phase)
+{
+    TraceEvent *event = &ring->events[ring->count++ & (TRACE_RING_EVENTS - 1)];
+    event->time = SDL_GetPerformanceCounter();
+    event->name = name;
+    event->phase = phase;
+}
+
+static inline void trace_begin(TraceRing *ring, const char *name)
+{
+    if (ring)
+        trace_event(ring, name, 'B');
+}
+
+static inline void trace_end(TraceRing *ring, const char *name)
+{
+    if (ring)
+        trace_event(ring, name, 'E');
+}
+
+// Once every traced thread has stopped: write the rings as Chrome trace
+// JSON, for chrome://tracing or ui.perfetto.dev, and free them
+void trace_close(void);
+
+#endif
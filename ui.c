@@ -0,0 +1,244 @@
+#include "ui.h"
+
+#define FONT_FIRST 32 // Space
+#define FONT_GLYPHS 64 // Space to underscore, lowercase is folded onto uppercase
+#define ATLAS_COLUMNS 16
+#define ATLAS_WIDTH 128
+#define ATLAS_HEIGHT 32
+#define WHITE_X 96 // Solid block right of the glyphs, sampled by shapes
+#define WHITE_SIZE 8
+
+// 5x7 glyphs, one byte per row, bit 4 is the leftmost pixel
+static const Uint8 font[FONT_GLYPHS][7] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // space
+    {0x04, 0x04, 0x04, 0x04, 0x00, 0x00, 0x04}, // !
+    {0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00}, // "
+    {0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A}, // #
+    {0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04}, // $
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}, // %
+    {0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D}, // &
+    {0x0C, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00}, // '
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}, // (
+    {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}, // )
+    {0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00}, // *
+    {0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00}, // +
+    {0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08}, // ,
+    {0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00}, // -
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C}, // .
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, // /
+    {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E}, // 0
+    {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E}, // 1
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F}, // 2
+    {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E}, // 3
+    {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02}, // 4
+    {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E}, // 5
+    {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E}, // 6
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, // 7
+    {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E}, // 8
+    {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C}, // 9
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00}, // :
+    {0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08}, // ;
+    {0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02}, // <
+    {0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00}, // =
+    {0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08}, // >
+    {0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04}, // ?
+    {0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E}, // @
+    {0x0E, 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11}, // A
+    {0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E}, // B
+    {0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E}, // C
+    {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C}, // D
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F}, // E
+    {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10}, // F
+    {0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F}, // G
+    {0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11}, // H
+    {0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E}, // I
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C}, // J
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, // K
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F}, // L
+    {0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11}, // M
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, // N
+    {0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // O
+    {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10}, // P
+    {0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D}, // Q
+    {0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11}, // R
+    {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E}, // S
+    {0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // T
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}, // U
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04}, // V
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A}, // W
+    {0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11}, // X
+    {0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04}, // Y
+    {0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F}, // Z
+    {0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E}, // [
+    {0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00}, // backslash
+    {0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E}, // ]
+    {0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00}, // ^
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F}, // _
+};
+
+bool ui_init(Ui *ui, SDL_Renderer *renderer)
+{
+    Uint8 pixels[ATLAS_HEIGHT][ATLAS_WIDTH][4];
+
+    SDL_zerop(ui);
+    ui->renderer = renderer;
+
+    // White everywhere so vertex colors tint it, coverage in alpha
+    SDL_memset(pixels, 0xFF, sizeof(pixels));
+    for (int y = 0; y < ATLAS_HEIGHT; y++)
+        for (int x = 0; x < ATLAS_WIDTH; x++)
+            pixels[y][x][3] = x >= WHITE_X && x < WHITE_X + WHITE_SIZE && y < WHITE_SIZE ? 0xFF : 0;
+
+    for (int g = 0; g < FONT_GLYPHS; g++)
+    {
+        int cell_x = g % ATLAS_COLUMNS * UI_GLYPH_WIDTH;
+        int cell_y = g / ATLAS_COLUMNS * UI_GLYPH_HEIGHT;
+        for (int row = 0; row < 7; row++)
+            for (int column = 0; column < 5; column++)
+                if (font[g][row] & (0x10 >> column))
+                    pixels[cell_y + row][cell_x + column][3] = 0xFF;
+    }
+
+    ui->atlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, ATLAS_WIDTH,
+                                  ATLAS_HEIGHT);
+    if (!ui->atlas)
+        return false;
+    SDL_UpdateTexture(ui->atlas, NULL, pixels, ATLAS_WIDTH * 4);
+    SDL_SetTextureBlendMode(ui->atlas, SDL_BLENDMODE_BLEND);
+
+    // Two triangles per quad, corners in the order add_quad() writes them
+    static const int pattern[6] = {0, 1, 2, 2, 3, 0};
+    for (int q = 0; q < UI_MAX_QUADS; q++)
+        for (int i = 0; i < 6; i++)
+            ui->indices[q * 6 + i] = q * 4 + pattern[i];
+    return true;
+}
+
+void ui_close(Ui *ui)
+{
+    if (ui->atlas)
+        SDL_DestroyTexture(ui->atlas);
+    ui->atlas = NULL;
+}
+
+void ui_begin(Ui *ui)
+{
+    ui->quad_count = 0;
+}
+
+// Screen rectangle x0,y0-x1,y1 showing atlas pixels u0,v0-u1,v1
+static void add_quad(Ui *ui, float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1,
+                     SDL_Color color)
+{
+    if (ui->quad_count >= UI_MAX_QUADS)
+        return;
+
+    SDL_Vertex *vertex = &ui->vertices[ui->quad_count++ * 4];
+    u0 /= ATLAS_WIDTH;
+    u1 /= ATLAS_WIDTH;
+    v0 /= ATLAS_HEIGHT;
+    v1 /= ATLAS_HEIGHT;
+    vertex[0] = (SDL_Vertex){{x0, y0}, color, {u0, v0}};
+    vertex[1] = (SDL_Vertex){{x1, y0}, color, {u1, v0}};
+    vertex[2] = (SDL_Vertex){{x1, y1}, color, {u1, v1}};
+    vertex[3] = (SDL_Vertex){{x0, y1}, color, {u0, v1}};
+}
+
+void ui_rect(Ui *ui, float x, float y, float w, float h, SDL_Color color)
+{
+    // Inner texels of the white block, filtering never reaches a glyph
+    float u = WHITE_X + WHITE_SIZE / 2;
+    float v = WHITE_SIZE / 2;
+    add_quad(ui, x, y, x + w, y + h, u - 1, v - 1, u + 1, v + 1, color);
+}
+
+float ui_text(Ui *ui, float x, float y, int scale, const char *text, SDL_Color color)
+{
+    float start = x;
+    float w = UI_GLYPH_WIDTH * scale;
+    float h = UI_GLYPH_HEIGHT * scale;
+
+    for (; *text; text++)
+    {
+        int c = SDL_toupper((unsigned char)*text) - FONT_FIRST;
+        if (c < 0 || c >= FONT_GLYPHS)
+            c = '?' - FONT_FIRST;
+
+        // Blank cells are skipped, they only advance the pen
+        if (c != 0)
+        {
+            float u = c % ATLAS_COLUMNS * UI_GLYPH_WIDTH;
+            float v = c / ATLAS_COLUMNS * UI_GLYPH_HEIGHT;
+            add_quad(ui, x, y, x + w, y + h, u, v, u + UI_GLYPH_WIDTH, v + UI_GLYPH_HEIGHT, color);
+        }
+        x += w;
+    }
+    return x - start;
+}
+
+float ui_text_width(const char *text, int scale)
+{
+    return (float)SDL_strlen(text) * UI_GLYPH_WIDTH * scale;
+}
+
+void ui_scope(Ui *ui, const SDL_FRect *area, const float *frames, int count, float gain, SDL_Color color)
+{
+    int view = count / 2;
+    int columns = (int)area->w;
+    float middle = area->y + area->h / 2;
+    float half = area->h / 2;
+
+    if (view < 1 || columns < 1)
+        return;
+
+    // Latest rising zero crossing that still leaves a full view after it
+    int start = view;
+    for (int i = view; i > 0; i--)
+    {
+        if (frames[i - 1] < 0.0f && frames[i] >= 0.0f)
+        {
+            start = i;
+            break;
+        }
+    }
+
+    for (int c = 0; c < columns; c++)
+    {
+        int first = start + (int)((Sint64)c * view / columns);
+        int last = start + (int)((Sint64)(c + 1) * view / columns);
+
+        // Include the next column's first frame so the trace stays joined
+        last = SDL_min(last, count - 1);
+        float low = frames[first];
+        float high = low;
+        for (int i = first + 1; i <= last; i++)
+        {
+            low = SDL_min(low, frames[i]);
+            high = SDL_max(high, frames[i]);
+        }
+
+        float top = SDL_max(middle - high * gain * half, area->y);
+        float bottom = SDL_min(middle - low * gain * half, area->y + area->h);
+        ui_rect(ui, area->x + c, top, 1, SDL_max(bottom - top, 1), color);
+    }
+}
+
+void ui_bars(Ui *ui, const SDL_FRect *area, const float *heights, int count, float gap, SDL_Color color)
+{
+    float width = (area->w + gap) / count - gap;
+    float bottom = area->y + area->h;
+
+    for (int i = 0; i < count; i++)
+    {
+        float h = SDL_min(SDL_max(heights[i], 0.0f), 1.0f) * area->h;
+        if (h > 0.0f)
+            ui_rect(ui, area->x + i * (width + gap), bottom - h, width, h, color);
+    }
+}
+
+void ui_draw(Ui *ui)
+{
+    if (ui->quad_count > 0)
+        SDL_RenderGeometry(ui->renderer, ui->atlas, ui->vertices, ui->quad_count * 4, ui->indices,
+                           ui->quad_count * 6);
+}
@@ -0,0 +1,51 @@
+#ifndef UI_H
+#define UI_H
+
+#include <SDL.h>
+#include <stdbool.h>
+
+#define UI_MAX_QUADS 2048 // Per frame, anything past this is dropped
+#define UI_GLYPH_WIDTH 6  // Character cell in atlas pixels, 5x7 glyphs plus spacing
+#define UI_GLYPH_HEIGHT 8
+
+// Batched 2D drawing. Everything in a frame, text and shapes alike, is a
+// textured quad from one atlas holding the built-in font and a white block,
+// so ui_draw() submits the whole frame with a single SDL_RenderGeometry().
+typedef struct Ui
+{
+    SDL_Renderer *renderer;
+    SDL_Texture *atlas;
+    int quad_count;
+    SDL_Vertex vertices[UI_MAX_QUADS * 4];
+    int indices[UI_MAX_QUADS * 6]; // Fixed pattern, filled once
+} Ui;
+
+// Build the glyph atlas, needs SDL 2.0.18 for SDL_RenderGeometry()
+bool ui_init(Ui *ui, SDL_Renderer *renderer);
+void ui_close(Ui *ui);
+
+// Start a new frame, dropping the previous one's quads
+void ui_begin(Ui *ui);
+
+void ui_rect(Ui *ui, float x, float y, float w, float h, SDL_Color color);
+
+// Text in the built-in font, ASCII with lowercase shown as uppercase,
+// `scale` atlas pixels per screen pixel. Returns the width drawn.
+float ui_text(Ui *ui, float x, float y, int scale, const char *text, SDL_Color color);
+float ui_text_width(const char *text, int scale);
+
+// Oscilloscope of `count` frames inside `area`, `gain` scales a frame
+// to the half height. The view spans count / 2 frames and starts at a
+// rising zero crossing in the first half when there is one, so a steady
+// tone stands still. One quad per pixel column covers the range of the
+// frames under it.
+void ui_scope(Ui *ui, const SDL_FRect *area, const float *frames, int count, float gain, SDL_Color color);
+
+// `count` bars side by side across `area`, rising from its bottom edge to
+// heights in 0..1, `gap` pixels apart
+void ui_bars(Ui *ui, const SDL_FRect *area, const float *heights, int count, float gap, SDL_Color color);
+
+// Submit the frame in one call
+void ui_draw(Ui *ui);
+
+#endif
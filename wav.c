@@ -0,0 +1,144 @@
+#include "wav.h"
+
+#define WAV_HEADER_BYTES 44
+#define WAV_IO_BUFFER (1 << 20)
+
+static void put_u16(Uint8 *p, Uint16 v)
+{
+    p[0] = (Uint8)v;
+    p[1] = (Uint8)(v >> 8);
+}
+
+static void put_u32(Uint8 *p, Uint32 v)
+{
+    p[0] = (Uint8)v;
+    p[1] = (Uint8)(v >> 8);
+    p[2] = (Uint8)(v >> 16);
+    p[3] = (Uint8)(v >> 24);
+}
+
+static Uint16 get_u16(const Uint8 *p)
+{
+    return (Uint16)(p[0] | p[1] << 8);
+}
+
+static Uint32 get_u32(const Uint8 *p)
+{
+    return (Uint32)p[0] | (Uint32)p[1] << 8 | (Uint32)p[2] << 16 | (Uint32)p[3] << 24;
+}
+
+static void build_header(Uint8 *h, int sample_rate, int channels, Uint32 data_bytes)
+{
+    SDL_memcpy(h, "RIFF", 4);
+    put_u32(h + 4, 36 + data_bytes);
+    SDL_memcpy(h + 8, "WAVEfmt ", 8);
+    put_u32(h + 16, 16);
+    put_u16(h + 20, 1); // PCM
+    put_u16(h + 22, (Uint16)channels);
+    put_u32(h + 24, (Uint32)sample_rate);
+    put_u32(h + 28, (Uint32)(sample_rate * channels * 2));
+    put_u16(h + 32, (Uint16)(channels * 2));
+    put_u16(h + 34, 16);
+    SDL_memcpy(h + 36, "data", 4);
+    put_u32(h + 40, data_bytes);
+}
+
+bool wav_open(WavWriter *wav, const char *path, int sample_rate, int channels)
+{
+    Uint8 header[WAV_HEADER_BYTES];
+
+    SDL_zerop(wav);
+    wav->file = fopen(path, "wb");
+    if (!wav->file)
+        return false;
+
+    // Large stdio buffer, the renderer hands over big blocks anyway
+    setvbuf(wav->file, NULL, _IOFBF, WAV_IO_BUFFER);
+
+    wav->sample_rate = sample_rate;
+    wav->channels = channels;
+    build_header(header, sample_rate, channels, 0);
+    return fwrite(header, 1, sizeof(header), wav->file) == sizeof(header);
+}
+
+bool wav_write(WavWriter *wav, const Sint16 *samples, int count)
+{
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+    size_t written = fwrite(samples, sizeof(Sint16), count, wav->file);
+#else
+    size_t written = 0;
+    for (int i = 0; i < count; i++)
+    {
+        Uint8 bytes[2];
+        put_u16(bytes, (Uint16)samples[i]);
+        written += fwrite(bytes, 2, 1, wav->file);
+    }
+#endif
+    wav->data_bytes += (Uint32)written * 2;
+    return written == (size_t)count;
+}
+
+bool wav_close(WavWriter *wav)
+{
+    Uint8 header[WAV_HEADER_BYTES];
+    bool ok = true;
+
+    if (!wav->file)
+        return false;
+
+    // Now that the length is known, rewrite the header in place
+    build_header(header, wav->sample_rate, wav->channels, wav->data_bytes);
+    if (fseek(wav->file, 0, SEEK_SET) != 0 || fwrite(header, 1, sizeof(header), wav->file) != sizeof(header))
+        ok = false;
+
+    ok = fclose(wav->file) == 0 && ok;
+    wav->file = NULL;
+    return ok;
+}
+
+bool wav_read_info(FILE *file, WavInfo *info)
+{
+    Uint8 chunk[8], fmt[40];
+    bool have_format = false;
+    int format = 0, bits = 0;
+
+    SDL_zerop(info);
+    if (fseek(file, 0, SEEK_SET) != 0 || fread(fmt, 1, 12, file) != 12 || SDL_memcmp(fmt, "RIFF", 4) != 0 ||
+        SDL_memcmp(fmt + 8, "WAVE", 4) != 0)
+        return false;
+
+    // Walk the chunks, skipping the ones we don't need
+    while (fread(chunk, 1, sizeof(chunk), file) == sizeof(chunk))
+    {
+        Uint32 size = get_u32(chunk + 4);
+        long next = ftell(file) + (long)size + (size & 1); // Chunks are word aligned
+
+        if (SDL_memcmp(chunk, "fmt ", 4) == 0 && size >= 16)
+        {
+            if (fread(fmt, 1, SDL_min(size, sizeof(fmt)), file) != SDL_min(size, sizeof(fmt)))
+                return false;
+            format = get_u16(fmt);
+            if (format == 0xFFFE && size >= 26) // WAVE_FORMAT_EXTENSIBLE, the sub-format GUID starts with the tag
+                format = get_u16(fmt + 24);
+            info->channels = get_u16(fmt + 2);
+            info->sample_rate = (int)get_u32(fmt + 4);
+            bits = get_u16(fmt + 14);
+            have_format = true;
+        }
+        else if (SDL_memcmp(chunk, "data", 4) == 0 && have_format)
+        {
+            if (!((format == 1 && bits == 16) || (format == 3 && bits == 32)) || info->channels < 1 ||
+                info->sample_rate <= 0)
+                return false;
+            info->is_float = format == 3;
+            info->bytes_per_sample = bits / 8;
+            info->frames = size / (Uint32)(info->bytes_per_sample * info->channels);
+            info->data_offset = ftell(file);
+            return true;
+        }
+
+        if (fseek(file, next, SEEK_SET) != 0)
+            return false;
+    }
+    return false;
+}
@@ -0,0 +1,38 @@
+#ifndef WAV_H
+#define WAV_H
+
+#include <SDL.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Streaming 16-bit PCM WAV writer. The header sizes are patched on close, so
+// any length can be written without knowing it up front.
+typedef struct WavWriter
+{
+    FILE *file;
+    int sample_rate;
+    int channels;
+    Uint32 data_bytes;
+} WavWriter;
+
+bool wav_open(WavWriter *wav, const char *path, int sample_rate, int channels);
+bool wav_write(WavWriter *wav, const Sint16 *samples, int count);
+bool wav_close(WavWriter *wav);
+
+// Layout of an existing WAV file, as found by wav_read_info()
+typedef struct WavInfo
+{
+    int sample_rate;
+    int channels;
+    int bytes_per_sample; // 2 for 16-bit PCM, 4 for 32-bit float
+    bool is_float;
+    Uint32 frames;
+    long data_offset; // File offset of the first sample frame
+} WavInfo;
+
+// Parse the header chunks of `file`, only reading as far as the start of
+// the sample data. Accepts 16-bit PCM and 32-bit float, plain or
+// WAVE_FORMAT_EXTENSIBLE.
+bool wav_read_info(FILE *file, WavInfo *info);
+
+#endif